@@ -11,26 +11,21 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = LoopSubdiv
 TEMPLATE = app
 
+include(core.pri)
+
 SOURCES += main.cpp\
         mainwindow.cpp \
     mainview.cpp \
+    meshjob.cpp \
     meshrenderer.cpp \
-    objfile.cpp \
-    mesh.cpp \
-    meshtools.cpp \
     settings.cpp
 
 HEADERS  += mainwindow.h \
     mainview.h \
-    face.h \
-    mesh.h \
+    meshjob.h \
     meshrenderer.h \
     renderer.h \
-    settings.h \
-    vertex.h \
-    halfedge.h \
-    meshtools.h \
-    objfile.h
+    settings.h
 
 FORMS    += mainwindow.ui
 
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Benchmark of the mesh core on models/*.obj.
+# Writes a JSON report, see README.md.
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG   += console release
+CONFIG   -= app_bundle debug
+
+# Keep the per-step qDebug() tracing of the core out of the measurements.
+DEFINES  += QT_NO_DEBUG_OUTPUT
+
+TARGET = loopsubdiv-bench
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,494 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <memory>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "objfile.h"
+#include "bvh.h"
+#include "limitsurface.h"
+#include "mesh.h"
+#include "meshtools.h"
+#include "parallel.h"
+#include "stencilkernels.h"
+#include "stenciltable.h"
+
+// Benchmarks the mesh core on the bundled models. Every phase is repeated and
+// both the best and the median wall time are reported, throughput is derived
+// from the best run. Output is a single JSON document.
+
+// Keeps the kernel loops from being optimised away.
+static volatile float kernelSink;
+
+static qint64 peakRSSBytes() {
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MACOS)
+    // Bytes on macOS...
+    return usage.ru_maxrss;
+#else
+    // ...kilobytes everywhere else.
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+static double msSince(QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1.0e6;
+}
+
+// Summarises the samples of one phase. Element counts that are zero are left out.
+static QJsonObject phaseStats(QVector<double> samples, qint64 vertices, qint64 halfEdges, qint64 faces) {
+    std::sort(samples.begin(), samples.end());
+
+    double best = samples.first();
+    double median = samples[samples.size() / 2];
+    double seconds = std::max(best, 1.0e-6) / 1000.0;
+
+    QJsonObject stats;
+    stats.insert("ms_min", best);
+    stats.insert("ms_median", median);
+
+    if (vertices > 0) {
+        stats.insert("vertices_per_s", vertices / seconds);
+    }
+    if (halfEdges > 0) {
+        stats.insert("halfedges_per_s", halfEdges / seconds);
+    }
+    if (faces > 0) {
+        stats.insert("faces_per_s", faces / seconds);
+    }
+
+    return stats;
+}
+
+static void runVertexPoints(Mesh& mesh) {
+    QVector3D sum;
+
+    // Isolated vertices have no HalfEdge to start from, subdivideLoop copies them.
+    for (unsigned int k = 0; k < mesh.numVertices(); k++) {
+        if (mesh.out(k) != Mesh::NoIndex) {
+            sum += vertexPoint(mesh, mesh.out(k));
+        }
+    }
+
+    kernelSink = sum.x();
+}
+
+static void runEdgePoints(Mesh& mesh) {
+    QVector3D sum;
+
+    for (unsigned int k = 0; k < mesh.numHalfEdges(); k++) {
+        if (k < mesh.twin(k)) {
+            sum += edgePoint(mesh, k);
+        }
+    }
+
+    kernelSink = sum.x();
+}
+
+// Evenly spread points on random faces, the same on every run.
+static QVector<FacePoint> samplePoints(const Mesh& mesh, int count) {
+    QVector<FacePoint> points(count);
+    quint32 state = 1;
+
+    for (int k = 0; k < count; k++) {
+        float r[3];
+        for (int i = 0; i < 3; i++) {
+            state = 1664525 * state + 1013904223;
+            r[i] = (state >> 8) / float(1 << 24);
+        }
+        if (r[1] + r[2] > 1.0f) {
+            r[1] = 1.0f - r[1];
+            r[2] = 1.0f - r[2];
+        }
+        points[k].face = qMin(unsigned(r[0] * mesh.numFaces()), mesh.numFaces() - 1);
+        points[k].u = r[1];
+        points[k].v = r[2];
+    }
+
+    return points;
+}
+
+// Rays from outside the mesh towards the centroids of random triangles, the
+// same on every run. Returns the number of hits.
+static int castRays(const TriangleBVH& bvh, const QVector<QVector3D>& coords, const QVector<unsigned int>& indices, int count) {
+    QVector3D lo = coords[0], hi = coords[0];
+    unsigned int numTriangles = indices.size() / 3;
+    quint32 state = 1;
+    int hits = 0;
+    RayHit hit;
+
+    for (int k = 1; k < coords.size(); k++) {
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(lo[i], coords[k][i]);
+            hi[i] = std::max(hi[i], coords[k][i]);
+        }
+    }
+    QVector3D origin = hi + (hi - lo);
+
+    for (int k = 0; k < count; k++) {
+        state = 1664525 * state + 1013904223;
+        unsigned int f = qMin(unsigned((state >> 8) / float(1 << 24) * numTriangles), numTriangles - 1);
+        QVector3D target = (coords[indices[3*f]] + coords[indices[3*f+1]] + coords[indices[3*f+2]]) / 3.0f;
+        if (bvh.intersect(coords, indices, origin, target - origin, hit)) {
+            hits++;
+        }
+    }
+
+    return hits;
+}
+
+static QJsonObject benchmarkModel(QString fileName, int levels, int repeat, bool implicitTriangles, int numPoints) {
+    QElapsedTimer timer;
+    QVector<double> samples;
+    QJsonObject result;
+
+    result.insert("name", QFileInfo(fileName).completeBaseName());
+    result.insert("file", fileName);
+
+    // OBJFile::OBJFile
+    for (int r = 0; r < repeat; r++) {
+        timer.start();
+        OBJFile loadedOBJFile(fileName);
+        samples.append(msSince(timer));
+    }
+
+    OBJFile loadedOBJFile(fileName);
+    result.insert("parse", phaseStats(samples,
+                                      loadedOBJFile.vertexCoords.size(),
+                                      loadedOBJFile.faceCoordInd.size(),
+                                      loadedOBJFile.faceValences.size()));
+
+    // Mesh::Mesh(OBJFile*), destruction is not part of the measurement.
+    std::unique_ptr<Mesh> mesh;
+    samples.clear();
+    for (int r = 0; r < repeat; r++) {
+        mesh.reset();
+        timer.start();
+        mesh.reset(new Mesh(&loadedOBJFile, implicitTriangles));
+        samples.append(msSince(timer));
+    }
+
+    result.insert("implicit_triangles", mesh->hasImplicitTriangles());
+    result.insert("build", phaseStats(samples,
+                                      mesh->numVertices(),
+                                      mesh->numHalfEdges(),
+                                      mesh->numFaces()));
+
+    // LimitSurface, set up on the base mesh and evaluated at numPoints points.
+    if (numPoints > 0 && mesh->numFaces() > 0) {
+        QVector<FacePoint> points = samplePoints(*mesh, numPoints);
+        QVector<QVector3D> positions, normals;
+        QJsonObject limit;
+
+        samples.clear();
+        for (int r = 0; r < repeat; r++) {
+            timer.start();
+            LimitSurface surface(*mesh);
+            samples.append(msSince(timer));
+        }
+        limit.insert("setup", phaseStats(samples, mesh->numVertices(), mesh->numHalfEdges(), mesh->numFaces()));
+
+        LimitSurface surface(*mesh);
+        samples.clear();
+        for (int r = 0; r < repeat; r++) {
+            timer.start();
+            surface.evaluate(points, positions, normals);
+            samples.append(msSince(timer));
+        }
+
+        QJsonObject evaluate = phaseStats(samples, 0, 0, 0);
+        evaluate.insert("points", numPoints);
+        double best = *std::min_element(samples.begin(), samples.end());
+        evaluate.insert("points_per_s", numPoints / (std::max(best, 1.0e-6) / 1000.0));
+        limit.insert("evaluate", evaluate);
+        result.insert("limitSurface", limit);
+    }
+
+    // StencilTable of the deepest level, built once and evaluated repeatedly.
+    {
+        QVector<QVector3D> control(mesh->numVertices());
+        QVector<QVector3D> positions;
+        QJsonObject stencils;
+
+        for (unsigned int v = 0; v < mesh->numVertices(); v++) {
+            control[v] = mesh->coords(v);
+        }
+
+        samples.clear();
+        timer.start();
+        StencilTable table(*mesh, levels);
+        samples.append(msSince(timer));
+        stencils.insert("build", phaseStats(samples, table.numStencils(), 0, 0));
+        stencils.insert("stencils", qint64(table.numStencils()));
+        stencils.insert("weights", qint64(table.numWeights()));
+
+        samples.clear();
+        for (int r = 0; r < repeat; r++) {
+            timer.start();
+            table.evaluate(control, positions);
+            samples.append(msSince(timer));
+        }
+        stencils.insert("evaluate", phaseStats(samples, table.numStencils(), 0, 0));
+        result.insert("stencilTable", stencils);
+    }
+
+    QJsonArray levelResults;
+
+    for (int k = 0; k <= levels; k++) {
+        QJsonObject level;
+        qint64 numVerts = mesh->numVertices();
+        qint64 numHalfEdges = mesh->numHalfEdges();
+        qint64 numFaces = mesh->numFaces();
+
+        level.insert("level", k);
+        level.insert("vertices", numVerts);
+        level.insert("halfedges", numHalfEdges);
+        level.insert("faces", numFaces);
+
+        // Mesh::extractAttributes with each normal weighting. Invalidated every
+        // time, the call does nothing while the attributes are there.
+        const NormalWeighting weightings[] = { NormalWeighting::Area, NormalWeighting::Fast, NormalWeighting::Angle };
+        const char* weightingPhases[] = { "extractAttributesArea", "extractAttributesFast", "extractAttributes" };
+        for (int w = 0; w < 3; w++) {
+            samples.clear();
+            for (int r = 0; r < repeat; r++) {
+                mesh->invalidateAttributes();
+                timer.start();
+                mesh->extractAttributes(false, weightings[w]);
+                samples.append(msSince(timer));
+            }
+            level.insert(weightingPhases[w], phaseStats(samples, numVerts, numHalfEdges, numFaces));
+        }
+
+        // TriangleBVH over the attributes: build, refit and picking rays
+        {
+            const int numRays = 1000;
+            TriangleBVH bvh;
+            QJsonObject picking;
+
+            samples.clear();
+            for (int r = 0; r < repeat; r++) {
+                timer.start();
+                bvh.build(mesh->getVertexCoords(), mesh->getPolyIndices());
+                samples.append(msSince(timer));
+            }
+            picking.insert("build", phaseStats(samples, 0, 0, numFaces));
+
+            samples.clear();
+            for (int r = 0; r < repeat; r++) {
+                timer.start();
+                bvh.refit(mesh->getVertexCoords(), mesh->getPolyIndices());
+                samples.append(msSince(timer));
+            }
+            picking.insert("refit", phaseStats(samples, 0, 0, numFaces));
+
+            samples.clear();
+            int hits = 0;
+            for (int r = 0; r < repeat; r++) {
+                timer.start();
+                hits = castRays(bvh, mesh->getVertexCoords(), mesh->getPolyIndices(), numRays);
+                samples.append(msSince(timer));
+            }
+            QJsonObject rays = phaseStats(samples, 0, 0, 0);
+            double best = *std::min_element(samples.begin(), samples.end());
+            rays.insert("rays", numRays);
+            rays.insert("hits", hits);
+            rays.insert("us_per_ray", best * 1000.0 / numRays);
+            picking.insert("rays", rays);
+            picking.insert("bytes", qint64(bvh.memoryBytes()));
+            level.insert("bvh", picking);
+        }
+
+        // vertexPoint and edgePoint on their own
+        samples.clear();
+        for (int r = 0; r < repeat; r++) {
+            timer.start();
+            runVertexPoints(*mesh);
+            samples.append(msSince(timer));
+        }
+        level.insert("vertexPoint", phaseStats(samples, numVerts, 0, 0));
+
+        samples.clear();
+        for (int r = 0; r < repeat; r++) {
+            timer.start();
+            runEdgePoints(*mesh);
+            samples.append(msSince(timer));
+        }
+        // One edgePoint call per twin pair covers both of its HalfEdges.
+        level.insert("edgePoint", phaseStats(samples, 0, numHalfEdges, 0));
+
+        // Mesh::subdivideLoop into level k+1, throughput is measured on the input level.
+        if (k < levels) {
+            std::unique_ptr<Mesh> refined;
+            samples.clear();
+            for (int r = 0; r < repeat; r++) {
+                refined.reset(new Mesh());
+                timer.start();
+                mesh->subdivideLoop(*refined);
+                samples.append(msSince(timer));
+            }
+            level.insert("subdivideLoop", phaseStats(samples, numVerts, numHalfEdges, numFaces));
+
+            // Mesh::subdivideLoopAttributes, level k+1 for display only
+            samples.clear();
+            for (int r = 0; r < repeat; r++) {
+                QVector<QVector3D> coords, normals;
+                QVector<unsigned int> indices, edges;
+                timer.start();
+                mesh->subdivideLoopAttributes(coords, normals, indices, edges);
+                samples.append(msSince(timer));
+            }
+            level.insert("subdivideLoopAttributes", phaseStats(samples, numVerts, numHalfEdges, numFaces));
+
+            mesh = std::move(refined);
+        }
+
+        level.insert("peak_rss_bytes", peakRSSBytes());
+        levelResults.append(level);
+    }
+
+    result.insert("levels", levelResults);
+    result.insert("peak_rss_bytes", peakRSSBytes());
+
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("loopsubdiv-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks OBJ loading, HalfEdge construction, Loop subdivision and attribute extraction.");
+    parser.addHelpOption();
+
+    QCommandLineOption modelsOption(QStringList() << "m" << "models",
+                                    "Directory with the .obj files to benchmark (default models).",
+                                    "dir", "models");
+    QCommandLineOption onlyOption(QStringList() << "only",
+                                  "Only benchmark this model, e.g. Fertility. May be repeated.",
+                                  "name");
+    QCommandLineOption levelsOption(QStringList() << "l" << "levels",
+                                    "Deepest subdivision level (default 4).",
+                                    "N", "4");
+    QCommandLineOption repeatOption(QStringList() << "r" << "repeat",
+                                    "Runs per measurement (default 5).",
+                                    "N", "5");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write the JSON report here instead of stdout.",
+                                    "file");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Worker threads, 1 runs serially (default: all cores).",
+                                     "N", "0");
+    QCommandLineOption pointsOption(QStringList() << "p" << "points",
+                                    "Points evaluated on the limit surface of every model, 0 skips it (default 1048576).",
+                                    "N", "1048576");
+    QCommandLineOption simdOption(QStringList() << "simd",
+                                  "Highest instruction set of the stencil kernels: scalar, sse4.1, avx2 or avx512 (default: the best the CPU has).",
+                                  "isa");
+    QCommandLineOption explicitOption(QStringList() << "explicit",
+                                      "Store next and face of every HalfEdge instead of using implicit triangle connectivity.");
+    parser.addOption(modelsOption);
+    parser.addOption(onlyOption);
+    parser.addOption(levelsOption);
+    parser.addOption(repeatOption);
+    parser.addOption(outputOption);
+    parser.addOption(pointsOption);
+    parser.addOption(explicitOption);
+    parser.addOption(threadsOption);
+    parser.addOption(simdOption);
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    bool levelsOk, repeatOk, pointsOk;
+    int levels = parser.value(levelsOption).toInt(&levelsOk);
+    int repeat = parser.value(repeatOption).toInt(&repeatOk);
+    int points = parser.value(pointsOption).toInt(&pointsOk);
+    if (!levelsOk || levels < 0 || !repeatOk || repeat < 1 || !pointsOk || points < 0) {
+        err << "Levels and points must be >= 0 and repeat >= 1\n";
+        return 1;
+    }
+
+    setParallelThreadCount(parser.value(threadsOption).toInt());
+
+    if (parser.isSet(simdOption)) {
+        bool found = false;
+        for (int l = int(SimdLevel::Scalar); l <= int(SimdLevel::AVX512); l++) {
+            if (parser.value(simdOption) == simdLevelName(SimdLevel(l))) {
+                setSimdLevel(SimdLevel(l));
+                found = true;
+            }
+        }
+        if (!found) {
+            err << "Unknown instruction set " << parser.value(simdOption) << "\n";
+            return 1;
+        }
+    }
+
+    QDir modelDir(parser.value(modelsOption));
+    QStringList modelFiles = modelDir.entryList(QStringList() << "*.obj", QDir::Files, QDir::Name);
+    QStringList only = parser.values(onlyOption);
+
+    QJsonArray modelResults;
+
+    for (const QString& modelFile : modelFiles) {
+        if (!only.isEmpty() && !only.contains(QFileInfo(modelFile).completeBaseName())) {
+            continue;
+        }
+
+        err << ":: " << modelFile << "\n";
+        err.flush();
+        modelResults.append(benchmarkModel(modelDir.filePath(modelFile), levels, repeat, !parser.isSet(explicitOption), points));
+    }
+
+    if (modelResults.size() == 0) {
+        err << "No models found in " << modelDir.path() << "\n";
+        return 1;
+    }
+
+    QJsonObject report;
+    report.insert("qt_version", QT_VERSION_STR);
+    report.insert("threads", parallelThreadCount());
+    report.insert("simd", simdLevelName(simdLevel()));
+    report.insert("levels", levels);
+    report.insert("repeat", repeat);
+    report.insert("points", points);
+    report.insert("models", modelResults);
+    report.insert("peak_rss_bytes", peakRSSBytes());
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile outFile(parser.value(outputOption));
+        if (!outFile.open(QIODevice::WriteOnly)) {
+            err << "Could not write " << outFile.fileName() << "\n";
+            return 1;
+        }
+        outFile.write(json);
+        outFile.close();
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+#include "bvh.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Most triangles in a leaf. Halving a larger range leaves at least two in each
+// leaf, so a tree over n > LeafSize triangles has fewer than n nodes.
+static const unsigned int LeafSize = 4;
+
+// Spreads the lowest 10 bits of x to every third bit.
+static inline quint64 spreadBits(unsigned int x) {
+    quint64 v = x & 0x3FF;
+    v = (v | (v << 16)) & 0x30000FF;
+    v = (v | (v << 8)) & 0x300F00F;
+    v = (v | (v << 4)) & 0x30C30C3;
+    v = (v | (v << 2)) & 0x9249249;
+    return v;
+}
+
+static inline unsigned int cell(float t) {
+    return (unsigned int)(qBound(0.0f, t, 1.0f) * 1023.0f);
+}
+
+TriangleBVH::TriangleBVH() {
+}
+
+TriangleBVH::~TriangleBVH() {
+}
+
+void TriangleBVH::clear() {
+    nodes.clear();
+    order.clear();
+    topNodes.clear();
+    subtrees.clear();
+}
+
+quint64 TriangleBVH::memoryBytes() const {
+    return quint64(nodes.capacity()) * sizeof(Node) + quint64(order.capacity()) * sizeof(unsigned int);
+}
+
+void TriangleBVH::build(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices) {
+    unsigned int n = indices.size() / 3;
+    unsigned int numChunks = parallelChunks(n);
+    QVector<QVector3D> centroids(n);
+    QVector<QVector3D> chunkLo(numChunks), chunkHi(numChunks);
+    QVector<quint64> keys(n);
+    QVector<unsigned int> ranges;
+    QVector3D lo, hi, extent;
+
+    clear();
+    if (n == 0) {
+        return;
+    }
+
+    parallelForChunks(n, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        QVector3D cLo(FLT_MAX, FLT_MAX, FLT_MAX), cHi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (unsigned int k = begin; k < end; k++) {
+            QVector3D c = (coords[indices[3*k]] + coords[indices[3*k+1]] + coords[indices[3*k+2]]) / 3.0f;
+            centroids[k] = c;
+            for (int i = 0; i < 3; i++) {
+                cLo[i] = std::min(cLo[i], c[i]);
+                cHi[i] = std::max(cHi[i], c[i]);
+            }
+        }
+        chunkLo[chunk] = cLo;
+        chunkHi[chunk] = cHi;
+    });
+
+    lo = chunkLo[0];
+    hi = chunkHi[0];
+    for (unsigned int c = 1; c < numChunks; c++) {
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(lo[i], chunkLo[c][i]);
+            hi[i] = std::max(hi[i], chunkHi[c][i]);
+        }
+    }
+    extent = hi - lo;
+    for (int i = 0; i < 3; i++) {
+        if (extent[i] <= 0.0f) {
+            extent[i] = 1.0f;
+        }
+    }
+
+    order.resize(n);
+    parallelFor(n, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            QVector3D t = (centroids[k] - lo) / extent;
+            keys[k] = spreadBits(cell(t.x())) | spreadBits(cell(t.y())) << 1 | spreadBits(cell(t.z())) << 2;
+            order[k] = k;
+        }
+    });
+    parallelRadixSort(keys, order, 30);
+
+    // Enough subtrees to keep every thread busy.
+    unsigned int depth = 0;
+    while ((1u << depth) < 4u * parallelThreadCount() && (n >> depth) > LeafSize) {
+        depth++;
+    }
+
+    QAtomicInt next(1);
+    nodes.resize(n);
+    splitTop(0, 0, n, depth, next, ranges);
+    parallelFor(subtrees.size(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int s = begin; s < end; s++) {
+            split(subtrees[s], ranges[2*s], ranges[2*s+1], next);
+        }
+    }, 1);
+    nodes.resize(next.load());
+    nodes.squeeze();
+
+    refit(coords, indices);
+}
+
+void TriangleBVH::splitTop(unsigned int node, unsigned int begin, unsigned int end, unsigned int depth, QAtomicInt& next, QVector<unsigned int>& ranges) {
+    if (depth == 0 && end - begin > LeafSize) {
+        subtrees.append(node);
+        ranges.append(begin);
+        ranges.append(end);
+        return;
+    }
+
+    topNodes.append(node);
+    if (end - begin <= LeafSize) {
+        nodes[node].first = begin;
+        nodes[node].count = end - begin;
+        return;
+    }
+
+    unsigned int children = next.fetchAndAddRelaxed(2);
+    unsigned int middle = begin + (end - begin) / 2;
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    splitTop(children, begin, middle, depth - 1, next, ranges);
+    splitTop(children + 1, middle, end, depth - 1, next, ranges);
+}
+
+void TriangleBVH::split(unsigned int node, unsigned int begin, unsigned int end, QAtomicInt& next) {
+    if (end - begin <= LeafSize) {
+        nodes[node].first = begin;
+        nodes[node].count = end - begin;
+        return;
+    }
+
+    unsigned int children = next.fetchAndAddRelaxed(2);
+    unsigned int middle = begin + (end - begin) / 2;
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    split(children, begin, middle, next);
+    split(children + 1, middle, end, next);
+}
+
+void TriangleBVH::refit(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices) {
+    parallelFor(subtrees.size(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int s = begin; s < end; s++) {
+            refitNode(subtrees[s], coords, indices);
+        }
+    }, 1);
+
+    // Children come after their parent in preorder.
+    for (int k = topNodes.size() - 1; k >= 0; k--) {
+        setBounds(topNodes[k], coords, indices);
+    }
+}
+
+void TriangleBVH::refitNode(unsigned int node, const QVector<QVector3D>& coords, const QVector<unsigned int>& indices) {
+    if (nodes[node].count == 0) {
+        refitNode(nodes[node].first, coords, indices);
+        refitNode(nodes[node].first + 1, coords, indices);
+    }
+    setBounds(node, coords, indices);
+}
+
+// From the triangles of a leaf, or the children of an inner node.
+void TriangleBVH::setBounds(unsigned int node, const QVector<QVector3D>& coords, const QVector<unsigned int>& indices) {
+    Node& current = nodes[node];
+
+    for (int i = 0; i < 3; i++) {
+        current.lo[i] = FLT_MAX;
+        current.hi[i] = -FLT_MAX;
+    }
+
+    if (current.count == 0) {
+        const Node& left = nodes[current.first];
+        const Node& right = nodes[current.first + 1];
+        for (int i = 0; i < 3; i++) {
+            current.lo[i] = std::min(left.lo[i], right.lo[i]);
+            current.hi[i] = std::max(left.hi[i], right.hi[i]);
+        }
+        return;
+    }
+
+    for (unsigned int k = current.first; k < current.first + current.count; k++) {
+        for (unsigned int c = 0; c < 3; c++) {
+            const QVector3D& p = coords[indices[3*order[k] + c]];
+            for (int i = 0; i < 3; i++) {
+                current.lo[i] = std::min(current.lo[i], p[i]);
+                current.hi[i] = std::max(current.hi[i], p[i]);
+            }
+        }
+    }
+}
+
+// Distance along the ray at which it enters the box, or FLT_MAX if it misses
+// the box or only meets it beyond maxT.
+static inline float enterBox(const float lo[3], const float hi[3], const float origin[3], const float inverse[3], float maxT) {
+    float tNear = 0.0f, tFar = maxT;
+
+    for (int i = 0; i < 3; i++) {
+        float t0 = (lo[i] - origin[i]) * inverse[i];
+        float t1 = (hi[i] - origin[i]) * inverse[i];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar) {
+            return FLT_MAX;
+        }
+    }
+    return tNear;
+}
+
+// Möller-Trumbore.
+static inline bool intersectTriangle(const QVector3D& origin, const QVector3D& direction,
+                                     const QVector3D& p0, const QVector3D& p1, const QVector3D& p2,
+                                     float& t, float& u, float& v) {
+    QVector3D e1 = p1 - p0;
+    QVector3D e2 = p2 - p0;
+    QVector3D p = QVector3D::crossProduct(direction, e2);
+    float det = QVector3D::dotProduct(e1, p);
+
+    if (std::fabs(det) < 1.0e-20f) {
+        return false;
+    }
+
+    float inverse = 1.0f / det;
+    QVector3D s = origin - p0;
+    u = QVector3D::dotProduct(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+
+    QVector3D q = QVector3D::crossProduct(s, e1);
+    v = QVector3D::dotProduct(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+
+    t = QVector3D::dotProduct(e2, q) * inverse;
+    return t > 0.0f;
+}
+
+bool TriangleBVH::intersect(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices,
+                            const QVector3D& origin, const QVector3D& direction, RayHit& hit) const {
+    float o[3] = { origin.x(), origin.y(), origin.z() };
+    float inverse[3];
+    float t, u, v;
+    bool found = false;
+
+    // Nodes still to visit and where the ray enters them, nearest on top. Each
+    // level of the tree leaves at most one sibling behind.
+    unsigned int stack[64];
+    float stackT[64];
+    int size = 0;
+
+    if (isEmpty()) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        float d = direction[i];
+        inverse[i] = std::fabs(d) > 1.0e-30f ? 1.0f / d : std::copysign(1.0e30f, d);
+    }
+
+    hit.t = FLT_MAX;
+    t = enterBox(nodes[0].lo, nodes[0].hi, o, inverse, hit.t);
+    if (t == FLT_MAX) {
+        return false;
+    }
+    stack[size] = 0;
+    stackT[size++] = t;
+
+    while (size > 0) {
+        size--;
+        if (stackT[size] > hit.t) {
+            continue;
+        }
+
+        const Node& node = nodes[stack[size]];
+
+        if (node.count > 0) {
+            for (unsigned int k = node.first; k < node.first + node.count; k++) {
+                unsigned int f = order[k];
+                if (intersectTriangle(origin, direction, coords[indices[3*f]], coords[indices[3*f+1]], coords[indices[3*f+2]], t, u, v)
+                        && t < hit.t) {
+                    hit.triangle = f;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        unsigned int closer = node.first, farther = node.first + 1;
+        float tCloser = enterBox(nodes[closer].lo, nodes[closer].hi, o, inverse, hit.t);
+        float tFarther = enterBox(nodes[farther].lo, nodes[farther].hi, o, inverse, hit.t);
+        if (tFarther < tCloser) {
+            std::swap(closer, farther);
+            std::swap(tCloser, tFarther);
+        }
+        if (tFarther != FLT_MAX) {
+            stack[size] = farther;
+            stackT[size++] = tFarther;
+        }
+        if (tCloser != FLT_MAX) {
+            stack[size] = closer;
+            stackT[size++] = tCloser;
+        }
+    }
+
+    return found;
+}
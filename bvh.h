@@ -0,0 +1,66 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QAtomicInt>
+#include <QVector>
+#include <QVector3D>
+
+// Closest intersection of a ray with a triangle. The hit point is origin +
+// t * direction, and (1-u-v) * corner 0 + u * corner 1 + v * corner 2.
+struct RayHit {
+    unsigned int triangle;
+    float t, u, v;
+};
+
+// Bounding volume hierarchy over a triangle list with three indices per
+// triangle, like Mesh::getPolyIndices. It keeps no copy of the coordinates or
+// the indices, pass the same arrays to every call.
+//
+// The triangles are sorted along a Morton curve through their centroids, and
+// every node splits its range of them in half. The tree shape then only
+// depends on the triangle count, so building is a parallel sort followed by a
+// parallel refit. Children are stored in pairs after their parent; the top
+// levels are handled serially, the subtrees below them in parallel.
+class TriangleBVH {
+
+public:
+    TriangleBVH();
+    ~TriangleBVH();
+
+    void build(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices);
+    // Recomputes the bounds after vertices moved. The indices must not change.
+    void refit(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices);
+    void clear();
+
+    inline bool isEmpty() const { return nodes.isEmpty(); }
+    inline unsigned int numNodes() const { return nodes.size(); }
+    quint64 memoryBytes() const;
+
+    // Closest hit with t > 0. Returns false if the ray misses every triangle.
+    bool intersect(const QVector<QVector3D>& coords, const QVector<unsigned int>& indices,
+                   const QVector3D& origin, const QVector3D& direction, RayHit& hit) const;
+
+private:
+    // Leaves cover [first, first + count) of order. Inner nodes have count 0
+    // and their children at first and first + 1.
+    struct Node {
+        float lo[3], hi[3];
+        unsigned int first;
+        unsigned int count;
+    };
+
+    void splitTop(unsigned int node, unsigned int begin, unsigned int end, unsigned int depth, QAtomicInt& next, QVector<unsigned int>& ranges);
+    void split(unsigned int node, unsigned int begin, unsigned int end, QAtomicInt& next);
+    void refitNode(unsigned int node, const QVector<QVector3D>& coords, const QVector<unsigned int>& indices);
+    void setBounds(unsigned int node, const QVector<QVector3D>& coords, const QVector<unsigned int>& indices);
+
+    QVector<Node> nodes;
+    // Triangles in Morton order.
+    QVector<unsigned int> order;
+    // The serially built top of the tree in preorder, and the roots of the
+    // subtrees below it.
+    QVector<unsigned int> topNodes;
+    QVector<unsigned int> subtrees;
+};
+
+#endif // BVH_H
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Headless Loop subdivision tool. Shares the mesh
+# core with LoopSubdiv but links neither QtWidgets
+# nor needs an OpenGL context.
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+# Keep the per-step qDebug() tracing of the core out of timed runs.
+DEFINES  += QT_NO_DEBUG_OUTPUT
+
+TARGET = loopsubdiv-cli
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,182 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <memory>
+
+#include "objfile.h"
+#include "mesh.h"
+#include "meshtools.h"
+#include "meshstream.h"
+#include "parallel.h"
+
+// Headless counterpart of MainWindow::loadOBJ + on_SubdivSteps_valueChanged.
+// Loads an OBJ, builds the HalfEdge mesh, applies N Loop steps, extracts the
+// render attributes of the final level and optionally writes it back out.
+// Binary .lsdmesh files can be used on both ends to skip parsing and building.
+// Every phase is timed separately and reported on stdout.
+
+static double msSince(QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1.0e6;
+}
+
+static void reportPhase(QTextStream& out, QString phase, double ms, Mesh& mesh) {
+    out << QString("%1 %2 ms").arg(phase, -22).arg(ms, 10, 'f', 3)
+        << QString("   V %1  H %2  F %3").arg(mesh.numVertices())
+                                         .arg(mesh.numHalfEdges())
+                                         .arg(mesh.numFaces())
+        << "\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("loopsubdiv-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Loop subdivision of OBJ meshes without a display.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Triangle mesh to subdivide (.obj or .lsdmesh).");
+    parser.addPositionalArgument("output", "Where to write the final level (.obj or .lsdmesh). Optional.", "[output]");
+
+    QCommandLineOption levelsOption(QStringList() << "l" << "levels",
+                                    "Number of Loop subdivision steps (default 1).",
+                                    "N", "1");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Worker threads, 1 runs serially (default: all cores).",
+                                     "N", "0");
+    QCommandLineOption streamOption(QStringList() << "stream",
+                                    "Subdivide patch by patch and write the final level straight to the output (.obj), for meshes larger than memory.");
+    QCommandLineOption patchOption(QStringList() << "patch-faces",
+                                   "With --stream, the number of final level faces per patch (default 4194304).",
+                                   "N", "0");
+    QCommandLineOption limitOption(QStringList() << "limit",
+                                   "Extract limit positions and normals instead of the control points.");
+    QCommandLineOption normalsOption(QStringList() << "normals",
+                                     "Weighting of the face normals around a vertex: angle, area or fast (default angle).",
+                                     "MODE", "angle");
+    QCommandLineOption explicitOption(QStringList() << "explicit",
+                                      "Store next and face of every HalfEdge instead of using implicit triangle connectivity.");
+    parser.addOption(levelsOption);
+    parser.addOption(explicitOption);
+    parser.addOption(threadsOption);
+    parser.addOption(limitOption);
+    parser.addOption(normalsOption);
+    parser.addOption(streamOption);
+    parser.addOption(patchOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList args = parser.positionalArguments();
+    if (args.size() < 1 || args.size() > 2) {
+        parser.showHelp(1);
+    }
+
+    bool ok;
+    int levels = parser.value(levelsOption).toInt(&ok);
+    if (!ok || levels < 0) {
+        err << "Invalid number of levels: " << parser.value(levelsOption) << "\n";
+        return 1;
+    }
+
+    NormalWeighting weighting;
+    QString normals = parser.value(normalsOption);
+    if (normals == "angle") {
+        weighting = NormalWeighting::Angle;
+    } else if (normals == "area") {
+        weighting = NormalWeighting::Area;
+    } else if (normals == "fast") {
+        weighting = NormalWeighting::Fast;
+    } else {
+        err << "Invalid normal weighting: " << normals << "\n";
+        return 1;
+    }
+
+    if (parser.isSet(streamOption) && args.size() != 2) {
+        err << "--stream needs an output file\n";
+        return 1;
+    }
+
+    setParallelThreadCount(parser.value(threadsOption).toInt());
+
+    QElapsedTimer timer;
+    QElapsedTimer total;
+    total.start();
+
+    std::unique_ptr<Mesh> mesh(new Mesh());
+
+    if (args[0].endsWith(".lsdmesh")) {
+        // Binary mesh files already contain the HalfEdges.
+        timer.start();
+        if (!mesh->readBinary(args[0])) {
+            err << "Could not load a mesh from " << args[0] << "\n";
+            return 1;
+        }
+        reportPhase(out, "load", msSince(timer), *mesh);
+    } else {
+        // Parse
+        timer.start();
+        OBJFile* loadedOBJFile = new OBJFile(args[0]);
+        double parseTime = msSince(timer);
+
+        if (loadedOBJFile->vertexCoords.isEmpty() || loadedOBJFile->faceValences.isEmpty()) {
+            err << "Could not load a mesh from " << args[0] << "\n";
+            delete loadedOBJFile;
+            return 1;
+        }
+
+        // HalfEdge build
+        timer.start();
+        mesh.reset(new Mesh(loadedOBJFile, !parser.isSet(explicitOption)));
+        double buildTime = msSince(timer);
+        delete loadedOBJFile;
+
+        out << QString("%1 %2 ms").arg("parse", -22).arg(parseTime, 10, 'f', 3) << "\n";
+        reportPhase(out, "halfedge build", buildTime, *mesh);
+    }
+
+    if (parser.isSet(streamOption)) {
+        timer.start();
+        if (!subdivideLoopToOBJ(*mesh, levels, args[1], parser.value(patchOption).toULongLong())) {
+            err << "Could not write " << args[1] << "\n";
+            return 1;
+        }
+        out << QString("%1 %2 ms").arg("stream subdivide+write", -22).arg(msSince(timer), 10, 'f', 3) << "\n";
+        out << QString("%1 %2 ms").arg("total", -22).arg(msSince(total), 10, 'f', 3) << "\n";
+        return 0;
+    }
+
+    // Subdivide, only the level being refined and its child are kept alive.
+    for (int k = 1; k <= levels; k++) {
+        std::unique_ptr<Mesh> refined(new Mesh());
+
+        timer.start();
+        mesh->subdivideLoop(*refined);
+        double levelTime = msSince(timer);
+
+        mesh = std::move(refined);
+        reportPhase(out, QString("subdivide level %1").arg(k), levelTime, *mesh);
+    }
+
+    // Attribute extraction, as done by MeshRenderer::updateBuffers.
+    timer.start();
+    mesh->extractAttributes(parser.isSet(limitOption), weighting);
+    reportPhase(out, "extract attributes", msSince(timer), *mesh);
+
+    if (args.size() == 2) {
+        timer.start();
+        bool written = args[1].endsWith(".lsdmesh") ? mesh->writeBinary(args[1]) : mesh->writeOBJ(args[1]);
+        if (!written) {
+            err << "Could not write " << args[1] << "\n";
+            return 1;
+        }
+        reportPhase(out, "write", msSince(timer), *mesh);
+    }
+
+    out << QString("%1 %2 ms").arg("total", -22).arg(msSince(total), 10, 'f', 3) << "\n";
+
+    return 0;
+}
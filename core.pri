@@ -0,0 +1,31 @@
+# Mesh core shared by the LoopSubdiv viewer and the command-line tools.
+# Only needs QtCore, QtConcurrent and QtGui (for QVector3D); no widgets or GL context.
+
+QT += concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/bvh.cpp \
+    $$PWD/objfile.cpp \
+    $$PWD/levelcache.cpp \
+    $$PWD/limitsurface.cpp \
+    $$PWD/mesh.cpp \
+    $$PWD/meshfile.cpp \
+    $$PWD/meshstream.cpp \
+    $$PWD/meshtools.cpp \
+    $$PWD/parallel.cpp \
+    $$PWD/stencilkernels.cpp \
+    $$PWD/stenciltable.cpp
+
+HEADERS += \
+    $$PWD/bvh.h \
+    $$PWD/levelcache.h \
+    $$PWD/limitsurface.h \
+    $$PWD/mesh.h \
+    $$PWD/meshstream.h \
+    $$PWD/meshtools.h \
+    $$PWD/objfile.h \
+    $$PWD/parallel.h \
+    $$PWD/stencilkernels.h \
+    $$PWD/stenciltable.h
@@ -0,0 +1,97 @@
+#include "levelcache.h"
+#include "meshtools.h"
+
+LevelCache::LevelCache() : maxBytes(quint64(1) << 30) {
+}
+
+LevelCache::~LevelCache() {
+    clear();
+}
+
+void LevelCache::clear() {
+    levels.clear();
+    levels.squeeze();
+}
+
+void LevelCache::setBase(const Mesh& base) {
+    clear();
+    levels.append(base);
+}
+
+Mesh& LevelCache::level(unsigned int k) {
+    if (!isResident(k)) {
+        unsigned int l;
+
+        if (numLevels() < k + 1) {
+            levels.resize(k + 1);
+        }
+
+        // Nearest resident ancestor, the base at worst.
+        for (l = k; l > 0 && !isResident(l); l--) {
+        }
+        for (; l < k; l++) {
+            levels[l].subdivideLoop(levels[l + 1]);
+        }
+
+        trim(k);
+    }
+
+    return levels[k];
+}
+
+quint64 LevelCache::bytes() const {
+    quint64 total = 0;
+    for (unsigned int l = 0; l < numLevels(); l++) {
+        total += bytes(l);
+    }
+    return total;
+}
+
+void LevelCache::trim(unsigned int keep) {
+    if (isEmpty()) {
+        return;
+    }
+
+    quint64 total = bytes();
+
+    auto evict = [&](unsigned int l) {
+        if (isResident(l)) {
+            qDebug() << ":: Evicting level" << l << "(" << bytes(l) << "bytes )";
+            total -= bytes(l);
+            levels[l] = Mesh();
+        }
+    };
+
+    // The levels above keep first, from the top down: they are the largest.
+    for (unsigned int l = numLevels() - 1; l > keep && total > maxBytes; l--) {
+        evict(l);
+    }
+    // Then the ones between the base and keep.
+    for (unsigned int l = qMin(keep, numLevels()); l-- > 1 && total > maxBytes; ) {
+        evict(l);
+    }
+
+    while (numLevels() > 1 && !isResident(numLevels() - 1)) {
+        levels.removeLast();
+    }
+}
+
+void LevelCache::moveVertex(unsigned int v, const QVector3D& position, unsigned int k, QVector<unsigned int>& changed) {
+    QVector<QVector<unsigned int> > levelChanges;
+    unsigned int resident;
+
+    ::moveVertex(levels, v, position, levelChanges);
+
+    // The update stopped at the first evicted level; the levels after it are
+    // stale now.
+    for (resident = 1; resident < numLevels() && isResident(resident); resident++) {
+    }
+    levels.resize(resident);
+
+    if (k < resident) {
+        changed = levelChanges[k];
+    } else {
+        changed.clear();
+        level(k);
+    }
+}
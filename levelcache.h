@@ -0,0 +1,49 @@
+#ifndef LEVELCACHE_H
+#define LEVELCACHE_H
+
+#include "mesh.h"
+
+// The subdivision levels of one base mesh, kept within a memory budget. Level
+// k+1 is about four times the size of level k, so after visiting a high level
+// the cache evicts levels until it fits again: first the ones above the
+// requested level (highest first), then the ones between it and the base. The
+// base mesh and the requested level always stay. An evicted level is
+// recomputed from the nearest level below it that is still there.
+class LevelCache {
+
+public:
+    LevelCache();
+    ~LevelCache();
+
+    void clear();
+    void setBase(const Mesh& base);
+    inline bool isEmpty() const { return levels.isEmpty(); }
+
+    // Level k, subdivided from the nearest resident level as needed.
+    Mesh& level(unsigned int k);
+    inline bool isResident(unsigned int k) const { return int(k) < levels.size() && levels[k].numVertices() > 0; }
+    inline unsigned int numLevels() const { return levels.size(); }
+
+    // Bytes held by level k (0 if evicted) resp. all levels, see Mesh::memoryBytes.
+    inline quint64 bytes(unsigned int k) const { return isResident(k) ? levels[k].memoryBytes() : 0; }
+    quint64 bytes() const;
+
+    inline quint64 budget() const { return maxBytes; }
+    inline void setBudget(quint64 bytes) { maxBytes = bytes; }
+    // Evicts levels until the cache fits the budget, keeping keep and the base.
+    // level() does this itself, call it after the levels grew otherwise (e.g.
+    // by extracting their render attributes).
+    void trim(unsigned int keep);
+
+    // Moves vertex v of the base mesh to position and brings level k up to
+    // date. If the levels up to k are resident, they are updated incrementally
+    // and changed lists the vertices of level k that moved (see moveVertex in
+    // meshtools.h). Otherwise level k is recomputed and changed is empty.
+    void moveVertex(unsigned int v, const QVector3D& position, unsigned int k, QVector<unsigned int>& changed);
+
+private:
+    QVector<Mesh> levels;
+    quint64 maxBytes;
+};
+
+#endif // LEVELCACHE_H
@@ -0,0 +1,471 @@
+#include "limitsurface.h"
+#include "meshtools.h"
+#include "parallel.h"
+
+#include <QVarLengthArray>
+
+#include <math.h>
+
+// Regular patches, numbered as in Stam's paper (minus one). The face is
+// (3, 6, 7) with weights (u, v, w); all points lie on the triangular lattice
+// spanned by its corners A, B and C:
+//
+//        0   1              0 = 2A-C    1 = 2A-B
+//      2   3   4            2 = A+B-C   3 = A       4 = A+C-B
+//    5   6   7   8          5 = 2B-C    6 = B       7 = C       8 = 2C-B
+//      9  10  11            9 = 2B-A   10 = B+C-A  11 = 2C-A
+static const int patchLattice[12][3] = {
+    { 2, 0, -1 }, { 2, -1, 0 },
+    { 1, 1, -1 }, { 1, 0, 0 }, { 1, -1, 1 },
+    { 0, 2, -1 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, -1, 2 },
+    { -1, 2, 0 }, { -1, 1, 1 }, { -1, 0, 2 }
+};
+
+// The quartic box spline basis function of point i is the sum of
+// coefficient/12 * u^a v^b w^c over its terms.
+struct BasisTerm {
+    unsigned char point, coefficient, a, b, c;
+};
+
+static const BasisTerm boxSplineTerms[] = {
+    { 0, 1, 4, 0, 0 }, { 0, 2, 3, 1, 0 },
+
+    { 1, 1, 4, 0, 0 }, { 1, 2, 3, 0, 1 },
+
+    { 2, 1, 4, 0, 0 }, { 2, 2, 3, 0, 1 }, { 2, 6, 3, 1, 0 }, { 2, 6, 2, 1, 1 }, { 2, 12, 2, 2, 0 },
+    { 2, 6, 1, 2, 1 }, { 2, 6, 1, 3, 0 }, { 2, 2, 0, 3, 1 }, { 2, 1, 0, 4, 0 },
+
+    { 3, 6, 4, 0, 0 }, { 3, 24, 3, 0, 1 }, { 3, 24, 2, 0, 2 }, { 3, 8, 1, 0, 3 }, { 3, 1, 0, 0, 4 },
+    { 3, 24, 3, 1, 0 }, { 3, 60, 2, 1, 1 }, { 3, 36, 1, 1, 2 }, { 3, 6, 0, 1, 3 }, { 3, 24, 2, 2, 0 },
+    { 3, 36, 1, 2, 1 }, { 3, 12, 0, 2, 2 }, { 3, 8, 1, 3, 0 }, { 3, 6, 0, 3, 1 }, { 3, 1, 0, 4, 0 },
+
+    { 4, 1, 4, 0, 0 }, { 4, 6, 3, 0, 1 }, { 4, 12, 2, 0, 2 }, { 4, 6, 1, 0, 3 }, { 4, 1, 0, 0, 4 },
+    { 4, 2, 3, 1, 0 }, { 4, 6, 2, 1, 1 }, { 4, 6, 1, 1, 2 }, { 4, 2, 0, 1, 3 },
+
+    { 5, 2, 1, 3, 0 }, { 5, 1, 0, 4, 0 },
+
+    { 6, 1, 4, 0, 0 }, { 6, 6, 3, 0, 1 }, { 6, 12, 2, 0, 2 }, { 6, 6, 1, 0, 3 }, { 6, 1, 0, 0, 4 },
+    { 6, 8, 3, 1, 0 }, { 6, 36, 2, 1, 1 }, { 6, 36, 1, 1, 2 }, { 6, 8, 0, 1, 3 }, { 6, 24, 2, 2, 0 },
+    { 6, 60, 1, 2, 1 }, { 6, 24, 0, 2, 2 }, { 6, 24, 1, 3, 0 }, { 6, 24, 0, 3, 1 }, { 6, 6, 0, 4, 0 },
+
+    { 7, 1, 4, 0, 0 }, { 7, 8, 3, 0, 1 }, { 7, 24, 2, 0, 2 }, { 7, 24, 1, 0, 3 }, { 7, 6, 0, 0, 4 },
+    { 7, 6, 3, 1, 0 }, { 7, 36, 2, 1, 1 }, { 7, 60, 1, 1, 2 }, { 7, 24, 0, 1, 3 }, { 7, 12, 2, 2, 0 },
+    { 7, 36, 1, 2, 1 }, { 7, 24, 0, 2, 2 }, { 7, 6, 1, 3, 0 }, { 7, 8, 0, 3, 1 }, { 7, 1, 0, 4, 0 },
+
+    { 8, 2, 1, 0, 3 }, { 8, 1, 0, 0, 4 },
+
+    { 9, 2, 0, 3, 1 }, { 9, 1, 0, 4, 0 },
+
+    { 10, 2, 1, 0, 3 }, { 10, 1, 0, 0, 4 }, { 10, 6, 1, 1, 2 }, { 10, 6, 0, 1, 3 }, { 10, 6, 1, 2, 1 },
+    { 10, 12, 0, 2, 2 }, { 10, 2, 1, 3, 0 }, { 10, 6, 0, 3, 1 }, { 10, 1, 0, 4, 0 },
+
+    { 11, 1, 0, 0, 4 }, { 11, 2, 0, 1, 3 }
+};
+
+// Position and the derivatives along v and w (with u = 1-v-w) of a regular patch.
+static void evaluateRegular(const QVector3D* p, float v, float w, QVector3D& position, QVector3D& dv, QVector3D& dw) {
+    float u = 1.0f - v - w;
+    float pu[5], pv[5], pw[5];
+    float value[12] = { 0 }, du[12] = { 0 }, dvBasis[12] = { 0 }, dwBasis[12] = { 0 };
+
+    pu[0] = pv[0] = pw[0] = 1.0f;
+    for (int k = 1; k < 5; k++) {
+        pu[k] = pu[k - 1] * u;
+        pv[k] = pv[k - 1] * v;
+        pw[k] = pw[k - 1] * w;
+    }
+
+    for (unsigned int t = 0; t < sizeof(boxSplineTerms) / sizeof(BasisTerm); t++) {
+        const BasisTerm& term = boxSplineTerms[t];
+        float c = term.coefficient;
+
+        value[term.point] += c * pu[term.a] * pv[term.b] * pw[term.c];
+        if (term.a > 0) {
+            du[term.point] += c * term.a * pu[term.a - 1] * pv[term.b] * pw[term.c];
+        }
+        if (term.b > 0) {
+            dvBasis[term.point] += c * term.b * pu[term.a] * pv[term.b - 1] * pw[term.c];
+        }
+        if (term.c > 0) {
+            dwBasis[term.point] += c * term.c * pu[term.a] * pv[term.b] * pw[term.c - 1];
+        }
+    }
+
+    position = dv = dw = QVector3D();
+    for (int i = 0; i < 12; i++) {
+        position += (value[i] / 12.0f) * p[i];
+        dv += ((dvBasis[i] - du[i]) / 12.0f) * p[i];
+        dw += ((dwBasis[i] - du[i]) / 12.0f) * p[i];
+    }
+}
+
+// Whether the rotation around the tail of h closes after n interior HalfEdges.
+static bool closedRing(const Mesh& mesh, unsigned int h, unsigned short n) {
+    unsigned int currentEdge = h;
+
+    for (unsigned short k = 0; k < n; k++) {
+        if (mesh.face(currentEdge) == Mesh::NoIndex) {
+            return false;
+        }
+        currentEdge = mesh.next(mesh.twin(currentEdge));
+    }
+
+    return currentEdge == h;
+}
+
+// Control points of the regular patch of the face with HalfEdge ab, from corner
+// A to corner B. Clockwise around A starting at 2 come 0 and 1, around B starting
+// at 10 come 9 and 5, and around C starting at 4 come 8 and 11.
+static void regularPatch(const Mesh& mesh, unsigned int ab, QVector3D* p) {
+    unsigned int bc = mesh.next(ab);
+    unsigned int ca = mesh.next(bc);
+    unsigned int h;
+
+    p[3] = mesh.coords(mesh.target(ca));
+    p[6] = mesh.coords(mesh.target(ab));
+    p[7] = mesh.coords(mesh.target(bc));
+
+    h = mesh.next(mesh.twin(ab));
+    p[2] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[0] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[1] = mesh.coords(mesh.target(h));
+
+    h = mesh.next(mesh.twin(bc));
+    p[10] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[9] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[5] = mesh.coords(mesh.target(h));
+
+    h = mesh.next(mesh.twin(ca));
+    p[4] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[8] = mesh.coords(mesh.target(h));
+    h = mesh.next(mesh.twin(h));
+    p[11] = mesh.coords(mesh.target(h));
+}
+
+// Irregular patches: the face (E, r0, r1) with the extraordinary vertex E of
+// valence n. Stored are E, its ring r0 .. r(n-1) counterclockwise, the outer
+// neighbours a, b, c of r0 (counterclockwise after r(n-1)) and the outer
+// neighbours d, e of r1 (counterclockwise after c), n+6 points in total.
+typedef QVarLengthArray<QVector3D, 32> IrregularPatch;
+
+// h0 runs from E to r0.
+static void irregularPatch(const Mesh& mesh, unsigned int h0, unsigned short n, IrregularPatch& p) {
+    unsigned int h = h0;
+    unsigned int last = h0;
+
+    p.resize(n + 6);
+    p[0] = mesh.coords(mesh.target(mesh.twin(h0)));
+
+    // Counterclockwise is the inverse of the rotation next(twin(h)).
+    for (unsigned short k = 0; k < n; k++) {
+        p[1 + k] = mesh.coords(mesh.target(h));
+        last = h;
+        h = mesh.twin(mesh.prev(h));
+    }
+
+    // From r0 to r(n-1), then a, b, c.
+    h = mesh.twin(mesh.next(last));
+    for (unsigned short k = 0; k < 3; k++) {
+        h = mesh.twin(mesh.prev(h));
+        p[n + 1 + k] = mesh.coords(mesh.target(h));
+    }
+
+    // From r1 to r0, then c, d, e.
+    h = mesh.twin(mesh.prev(mesh.twin(mesh.next(h0))));
+    for (unsigned short k = 0; k < 2; k++) {
+        h = mesh.twin(mesh.prev(h));
+        p[n + 4 + k] = mesh.coords(mesh.target(h));
+    }
+}
+
+// One Loop step on an irregular patch: the patch of the child face at E.
+static void subdividePatch(const IrregularPatch& p, unsigned short n, float beta, IrregularPatch& q) {
+    const QVector3D* r = p.constData() + 1;
+    const QVector3D& e = p[0];
+    QVector3D sum;
+
+    q.resize(n + 6);
+
+    for (unsigned short k = 0; k < n; k++) {
+        sum += r[k];
+        q[1 + k] = 0.375f * (e + r[k]) + 0.125f * (r[(k + n - 1) % n] + r[(k + 1) % n]);
+    }
+    q[0] = (1.0f - n * beta) * e + beta * sum;
+
+    // Edge point of r0 r(n-1), vertex point of r0, edge point of r0 r1, vertex
+    // point of r1 and edge point of r1 r2; r0 and r1 are regular.
+    q[n + 1] = 0.375f * (r[0] + r[n - 1]) + 0.125f * (e + p[n + 1]);
+    q[n + 2] = 0.625f * r[0] + 0.0625f * (r[1] + e + r[n - 1] + p[n + 1] + p[n + 2] + p[n + 3]);
+    q[n + 3] = 0.375f * (r[0] + r[1]) + 0.125f * (e + p[n + 3]);
+    q[n + 4] = 0.625f * r[1] + 0.0625f * (r[2] + e + r[0] + p[n + 3] + p[n + 4] + p[n + 5]);
+    q[n + 5] = 0.375f * (r[1] + r[2]) + 0.125f * (e + p[n + 5]);
+}
+
+// After one step, the three regular children of an irregular patch lie on the
+// lattice spanned by the child points of r0 (1, 0) and r1 (0, 1) around the
+// new E at (0, 0). The grid holds the points at (-1..3, -1..3) they use.
+static inline int gridIndex(int i, int j) {
+    return 5 * (i + 1) + j + 1;
+}
+
+static void patchGrid(const IrregularPatch& p, unsigned short n, float beta, QVector3D* grid) {
+    const QVector3D* r = p.constData() + 1;
+    const QVector3D& a = p[n + 1];
+    const QVector3D& b = p[n + 2];
+    const QVector3D& c = p[n + 3];
+    const QVector3D& d = p[n + 4];
+    const QVector3D& e = p[n + 5];
+    IrregularPatch q;
+
+    subdividePatch(p, n, beta, q);
+
+    grid[gridIndex(0, 0)] = q[0];
+    grid[gridIndex(1, 0)] = q[1];
+    grid[gridIndex(0, 1)] = q[2];
+    grid[gridIndex(-1, 1)] = q[3];
+    grid[gridIndex(1, -1)] = q[n];
+    grid[gridIndex(2, -1)] = q[n + 1];
+    grid[gridIndex(2, 0)] = q[n + 2];
+    grid[gridIndex(1, 1)] = q[n + 3];
+    grid[gridIndex(0, 2)] = q[n + 4];
+    grid[gridIndex(-1, 2)] = q[n + 5];
+
+    // Edge points of the outer edges of r0 and r1.
+    grid[gridIndex(3, -1)] = 0.375f * (r[0] + a) + 0.125f * (r[n - 1] + b);
+    grid[gridIndex(3, 0)] = 0.375f * (r[0] + b) + 0.125f * (a + c);
+    grid[gridIndex(2, 1)] = 0.375f * (r[0] + c) + 0.125f * (b + r[1]);
+    grid[gridIndex(1, 2)] = 0.375f * (r[1] + c) + 0.125f * (r[0] + d);
+    grid[gridIndex(0, 3)] = 0.375f * (r[1] + d) + 0.125f * (c + e);
+    grid[gridIndex(-1, 3)] = 0.375f * (r[1] + e) + 0.125f * (d + r[2]);
+}
+
+// Regular patch of the child face (A, B, C), given by lattice positions.
+static void latticePatch(const QVector3D* grid, const int* a, const int* b, const int* c, QVector3D* p) {
+    for (int k = 0; k < 12; k++) {
+        const int* m = patchLattice[k];
+        p[k] = grid[gridIndex(m[0] * a[0] + m[1] * b[0] + m[2] * c[0], m[0] * a[1] + m[1] * b[1] + m[2] * c[1])];
+    }
+}
+
+LimitSurface::LimitSurface(const Mesh& mesh) {
+    qDebug() << "✓✓ LimitSurface constructor";
+
+    valid = true;
+    numBaseFaces = mesh.numFaces();
+
+    if (mesh.hasImplicitTriangles()) {
+        mesh.subdivideLoop(refined);
+    } else {
+        // An implicit copy with the corners in the order of side(f), so the
+        // children of face f are 4f..4f+3 like above.
+        OBJFile triangles;
+
+        triangles.vertexCoords.resize(mesh.numVertices());
+        for (unsigned int v = 0; v < mesh.numVertices(); v++) {
+            triangles.vertexCoords[v] = mesh.coords(v);
+        }
+
+        for (unsigned int f = 0; f < numBaseFaces; f++) {
+            if (mesh.faceValence(f) != 3) {
+                qWarning() << " ! Limit surface evaluation needs a triangle mesh";
+                valid = false;
+                return;
+            }
+
+            unsigned int h = mesh.side(f);
+            for (unsigned int i = 0; i < 3; i++) {
+                triangles.faceCoordInd.append(mesh.target(h));
+                h = mesh.next(h);
+            }
+            triangles.faceValences.append(3);
+        }
+
+        Mesh copy(&triangles, true);
+        copy.subdivideLoop(refined);
+    }
+
+    unsigned short maxValence = 0;
+    for (unsigned int v = 0; v < refined.numVertices(); v++) {
+        maxValence = qMax(maxValence, refined.valence(v));
+    }
+
+    valenceBeta.resize(maxValence + 1);
+    valenceLimit.resize(maxValence + 1);
+    maskStart.resize(maxValence + 2);
+    maskStart[0] = 0;
+
+    for (unsigned short n = 0; n <= maxValence; n++) {
+        float beta = (n == 3) ? 3.0/16.0 : 3.0/(8*qMax(n, (unsigned short)1));
+        valenceBeta[n] = beta;
+        valenceLimit[n] = 1.0 / (3.0 / (8.0 * beta) + n);
+        maskStart[n + 1] = maskStart[n] + n;
+
+        for (unsigned short k = 0; k < n; k++) {
+            cosMask.append(cos(2.0 * M_PI * k / n));
+            sinMask.append(sin(2.0 * M_PI * k / n));
+        }
+    }
+}
+
+LimitSurface::~LimitSurface() {
+    qDebug() << "✗✗ LimitSurface destructor";
+}
+
+void LimitSurface::evaluate(const QVector<FacePoint>& points, QVector<QVector3D>& positions, QVector<QVector3D>& normals) const {
+    positions.resize(points.size());
+    normals.resize(points.size());
+
+    if (!valid) {
+        return;
+    }
+
+    const FacePoint* in = points.constData();
+    QVector3D* outPositions = positions.data();
+    QVector3D* outNormals = normals.data();
+
+    parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            evaluatePoint(in[k], outPositions[k], outNormals[k]);
+        }
+    }, 256);
+}
+
+void LimitSurface::evaluatePoint(const FacePoint& point, QVector3D& position, QVector3D& normal) const {
+    if (point.face >= numBaseFaces) {
+        position = normal = QVector3D();
+        return;
+    }
+
+    // Points outside the triangle are moved onto it.
+    float pointU = qMax(0.0f, point.u);
+    float pointV = qMax(0.0f, point.v);
+    if (pointU + pointV > 1.0f) {
+        float sum = pointU + pointV;
+        pointU /= sum;
+        pointV /= sum;
+    }
+
+    // Child of the face on the refined mesh and the weights of its corners.
+    float b[3] = { 1.0f - pointU - pointV, pointU, pointV };
+    float c[3] = { 1.0f - 2.0f * b[2], 1.0f - 2.0f * b[0], 1.0f - 2.0f * b[1] };
+    unsigned int g = 4 * point.face + 3;
+
+    for (unsigned int i = 0; i < 3; i++) {
+        if (b[i] >= 0.5f) {
+            g = 4 * point.face + i;
+            c[0] = 2.0f * b[i] - 1.0f;
+            c[1] = 2.0f * b[(i + 1) % 3];
+            c[2] = 2.0f * b[(i + 2) % 3];
+            break;
+        }
+    }
+
+    // HalfEdge 3g+i ends in corner i, the next one leaves it.
+    unsigned int numExtraordinary = 0;
+    unsigned int corner = 0;
+    bool patch = true;
+
+    for (unsigned int i = 0; i < 3; i++) {
+        unsigned short n = refined.valence(refined.target(3 * g + i));
+        if (n < 3 || !closedRing(refined, refined.next(3 * g + i), n)) {
+            patch = false;
+        } else if (n != 6) {
+            numExtraordinary++;
+            corner = i;
+        }
+    }
+
+    if (!patch || numExtraordinary > 1) {
+        position = normal = QVector3D();
+        for (unsigned int i = 0; i < 3; i++) {
+            position += c[i] * limitPoint(refined, refined.next(3 * g + i));
+            normal += c[i] * limitNormal(refined, refined.next(3 * g + i));
+        }
+        normal.normalize();
+        return;
+    }
+
+    QVector3D p[12];
+    QVector3D dv, dw;
+
+    if (numExtraordinary == 0) {
+        regularPatch(refined, 3 * g + 1, p);
+        evaluateRegular(p, c[1], c[2], position, dv, dw);
+        normal = QVector3D::crossProduct(dv, dw).normalized();
+        return;
+    }
+
+    // Make the extraordinary vertex E, with weights (1-v-w, v, w) on (E, r0, r1).
+    unsigned int h0 = 3 * g + (corner + 1) % 3;
+    unsigned short n = refined.valence(refined.target(3 * g + corner));
+    float beta = valenceBeta[n];
+    float v = c[(corner + 1) % 3];
+    float w = c[(corner + 2) % 3];
+    IrregularPatch patchPoints, child;
+
+    irregularPatch(refined, h0, n, patchPoints);
+
+    // Every step halves the distance to E; the child at E is irregular again.
+    for (int level = 0; v + w < 0.5f; level++) {
+        if (v + w <= 0.0f || level == 48) {
+            const QVector3D* r = patchPoints.constData() + 1;
+            const float* cosine = cosMask.constData() + maskStart[n];
+            const float* sine = sinMask.constData() + maskStart[n];
+            QVector3D sum;
+
+            for (unsigned short k = 0; k < n; k++) {
+                sum += r[k];
+                dv += cosine[k] * r[k];
+                dw += sine[k] * r[k];
+            }
+
+            position = (1.0f - n * valenceLimit[n]) * patchPoints[0] + valenceLimit[n] * sum;
+            // The ring runs counterclockwise.
+            normal = QVector3D::crossProduct(dv.normalized(), dw.normalized()).normalized();
+            return;
+        }
+
+        subdividePatch(patchPoints, n, beta, child);
+        patchPoints.swap(child);
+        v *= 2.0f;
+        w *= 2.0f;
+    }
+
+    static const int latticeR0[2] = { 1, 0 };
+    static const int latticeR1[2] = { 0, 1 };
+    static const int latticeMid[2] = { 1, 1 };
+    static const int latticeVertexR0[2] = { 2, 0 };
+    static const int latticeVertexR1[2] = { 0, 2 };
+    QVector3D grid[25];
+
+    patchGrid(patchPoints, n, beta, grid);
+
+    if (v >= 0.5f) {
+        latticePatch(grid, latticeR0, latticeVertexR0, latticeMid, p);
+        evaluateRegular(p, 2.0f * v - 1.0f, 2.0f * w, position, dv, dw);
+    } else if (w >= 0.5f) {
+        latticePatch(grid, latticeR1, latticeMid, latticeVertexR1, p);
+        evaluateRegular(p, 2.0f * v, 2.0f * w - 1.0f, position, dv, dw);
+    } else {
+        latticePatch(grid, latticeMid, latticeR1, latticeR0, p);
+        evaluateRegular(p, 1.0f - 2.0f * v, 1.0f - 2.0f * w, position, dv, dw);
+    }
+
+    normal = QVector3D::crossProduct(dv, dw).normalized();
+}
+
+bool Mesh::evaluateLimit(const QVector<FacePoint>& points, QVector<QVector3D>& positions, QVector<QVector3D>& normals) const {
+    LimitSurface surface(*this);
+
+    if (!surface.isValid()) {
+        return false;
+    }
+
+    surface.evaluate(points, positions, normals);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef LIMITSURFACE_H
+#define LIMITSURFACE_H
+
+#include "mesh.h"
+
+// Direct evaluation of the Loop limit surface of a triangle mesh at arbitrary
+// face points, without subdividing the whole mesh (Stam 1998).
+//
+// The mesh is subdivided once, after which every face has at most one
+// extraordinary vertex. Faces with only regular vertices are quartic box
+// spline patches and are evaluated in closed form. On a face with an
+// extraordinary vertex the local control points are subdivided towards that
+// vertex until the point falls into one of the regular children; the vertex
+// itself gets its limit position and normal. Faces touching a boundary (or a
+// non-manifold vertex) have no such patch and get the barycentric blend of the
+// limit points and normals of their corners on the refined mesh.
+class LimitSurface {
+
+public:
+    LimitSurface(const Mesh& mesh);
+    ~LimitSurface();
+
+    // False if the mesh has faces that are not triangles.
+    inline bool isValid() const { return valid; }
+
+    // Evaluates all points in parallel. Normals have unit length. Points on
+    // faces that are not in the mesh get a zero position and normal; weights
+    // outside the triangle are clamped to it.
+    void evaluate(const QVector<FacePoint>& points, QVector<QVector3D>& positions, QVector<QVector3D>& normals) const;
+
+private:
+    void evaluatePoint(const FacePoint& point, QVector3D& position, QVector3D& normal) const;
+
+    bool valid;
+    unsigned int numBaseFaces;
+    Mesh refined;
+
+    // Per valence: Loop's vertex weight, the limit weight and the offset of the
+    // cosine and sine masks of the limit tangents.
+    QVector<float> valenceBeta;
+    QVector<float> valenceLimit;
+    QVector<unsigned int> maskStart;
+    QVector<float> cosMask, sinMask;
+};
+
+#endif // LIMITSURFACE_H
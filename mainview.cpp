@@ -7,6 +7,7 @@ MainView::MainView(QWidget *Parent) : QOpenGLWidget(Parent) {
     qDebug() << "✓✓ MainView constructor";
 
     scale = 1.0f;
+    movingVertex = false;
 }
 
 MainView::~MainView() {
@@ -60,8 +61,62 @@ void MainView::resizeGL(int newWidth, int newHeight) {
 }
 
 
-void MainView::updateBuffers(Mesh& currentMesh) {
-    mr.updateBuffers(currentMesh);
+void MainView::updateBuffers(int level, Mesh& currentMesh) {
+    makeCurrent();
+    mr.updateBuffers(level, currentMesh);
+    doneCurrent();
+
+    update();
+}
+
+void MainView::updateBuffers(int level, const QVector<QVector3D>& vertexCoords, const QVector<QVector3D>& vertexNormals,
+                             const QVector<unsigned int>& polyIndices, const QVector<unsigned int>& edgeIndices,
+                             const TriangleBVH& bvh) {
+    makeCurrent();
+    mr.updateBuffers(level, vertexCoords, vertexNormals, polyIndices, edgeIndices, bvh);
+    doneCurrent();
+
+    update();
+}
+
+bool MainView::hasLevel(int level) {
+    return mr.hasLevel(level, settings.limitSurface, settings.normalWeighting, settings.compactVertices);
+}
+
+void MainView::showLevel(int level) {
+    mr.showLevel(level);
+
+    update();
+}
+
+void MainView::releaseLevels(bool keepShown) {
+    makeCurrent();
+    mr.releaseLevels(keepShown);
+    doneCurrent();
+}
+
+void MainView::setGpuBudget(quint64 bytes) {
+    makeCurrent();
+    mr.setGpuBudget(bytes);
+    doneCurrent();
+}
+
+quint64 MainView::gpuBytes() const {
+    return mr.gpuBytes();
+}
+
+void MainView::updateCage(const Mesh& base) {
+    makeCurrent();
+    mr.updateCage(base);
+    doneCurrent();
+
+    update();
+}
+
+void MainView::updateVertices(Mesh& currentMesh, const QVector<unsigned int>& moved) {
+    makeCurrent();
+    mr.updateVertices(currentMesh, moved);
+    doneCurrent();
 
     update();
 }
@@ -86,12 +141,7 @@ void MainView::paintGL() {
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (settings.wireframeMode) {
-        glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
-    } else {
-        glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-    }
-
+    // Wireframe mode draws the edge list with GL_LINES, see MeshRenderer::draw.
     if (settings.modelLoaded) {
         mr.draw();
     }
@@ -111,7 +161,48 @@ QVector2D MainView::toNormalizedScreenCoordinates(int x, int y) {
 }
 
 
+// Moves the selected vertex parallel to the screen, following the mouse.
+void MainView::dragSelectedVertex(int x, int y) {
+    if (!movingVertex) {
+        movingVertex = true;
+        lastDragX = x;
+        lastDragY = y;
+        return;
+    }
+
+    // The selection is kept when another level is shown.
+    const QVector<QVector3D>& coords = mr.shownCoords();
+    if (mr.selectedVertex >= coords.size()) {
+        return;
+    }
+
+    bool invertible;
+    QMatrix4x4 toClip = settings.projectionMatrix * settings.modelViewMatrix;
+    QMatrix4x4 fromClip = toClip.inverted(&invertible);
+    QVector3D p = coords[mr.selectedVertex];
+    QVector4D clip = toClip * QVector4D(p, 1.0);
+
+    if (!invertible || clip.w() <= 0) {
+        return;
+    }
+
+    // Shift the NDC coordinates, keep the depth.
+    QVector2D delta = toNormalizedScreenCoordinates(x, y) - toNormalizedScreenCoordinates(lastDragX, lastDragY);
+    QVector4D moved = fromClip * QVector4D(clip.x() + delta.x() * clip.w(), clip.y() + delta.y() * clip.w(), clip.z(), clip.w());
+
+    emit selectedVertexDragged(mr.selectedVertex, moved.toVector3DAffine() - p);
+
+    lastDragX = x;
+    lastDragY = y;
+}
+
 void MainView::mouseMoveEvent(QMouseEvent* Event) {
+    if (Event->buttons() == Qt::LeftButton && (Event->modifiers() & Qt::ShiftModifier)
+            && settings.selectionMode == 1 && mr.selectedVertex != -1) {
+        dragSelectedVertex(Event->x(), Event->y());
+        return;
+    }
+
     if(Event->buttons() == Qt::LeftButton) {
 
         QVector2D sPos = toNormalizedScreenCoordinates(Event->x(), Event->y());
@@ -152,10 +243,13 @@ void MainView::mouseMoveEvent(QMouseEvent* Event) {
         // to reset drag
         dragging = false;
         oldVec = QVector3D();
+        movingVertex = false;
     }
 }
 
 void MainView::mouseReleaseEvent(QMouseEvent* event) {
+    movingVertex = false;
+
     if(event->x() == lastMousePressX && event->y() == lastMousePressY) {
         // Store point in NDC space.
         auto vec = QVector2D(toNormalizedScreenCoordinates(event->x(), event->y()));
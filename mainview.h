@@ -23,7 +23,22 @@ public:
     void setSubdivisionLevel(int level);
     void updateMatrices();
     void updateUniforms();
-    void updateBuffers(Mesh& currentMesh);
+    void updateBuffers(int level, Mesh& currentMesh);
+    void updateBuffers(int level, const QVector<QVector3D>& vertexCoords, const QVector<QVector3D>& vertexNormals,
+                       const QVector<unsigned int>& polyIndices, const QVector<unsigned int>& edgeIndices,
+                       const TriangleBVH& bvh = TriangleBVH());
+    void updateVertices(Mesh& currentMesh, const QVector<unsigned int>& moved);
+    // Per level GPU buffers, see MeshRenderer.
+    bool hasLevel(int level);
+    void showLevel(int level);
+    void releaseLevels(bool keepShown);
+    void setGpuBudget(quint64 bytes);
+    quint64 gpuBytes() const;
+    void updateCage(const Mesh& base);
+
+signals:
+    // Shift + left drag of the selected vertex, displacement in model coordinates.
+    void selectedVertexDragged(unsigned int v, QVector3D displacement);
 
 protected:
     void initializeGL();
@@ -41,6 +56,7 @@ private:
     QOpenGLDebugLogger debugLogger;
 
     QVector2D toNormalizedScreenCoordinates(int x, int y);
+    void dragSelectedVertex(int x, int y);
 
     void createShaderPrograms();
     void createBuffers();
@@ -51,6 +67,9 @@ private:
     QVector3D oldVec;
     QQuaternion rotationQuaternion;
     bool dragging;
+    // for moving the selected vertex
+    bool movingVertex;
+    int lastDragX, lastDragY;
 
 
     int lastMousePressX, lastMousePressY;
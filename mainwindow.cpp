@@ -4,31 +4,163 @@
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     qDebug() << "✓✓ MainWindow constructor";
     ui->setupUi(this);
+
+    levels.setBudget(quint64(ui->cacheBudget->value()) << 20);
+    ui->MainDisplay->setGpuBudget(quint64(ui->gpuBudget->value()) << 20);
+    showCacheUsage();
+
+    // Jobs run one at a time, next to the threads of the parallel loops.
+    job = nullptr;
+    levelPending = false;
+    keepHalfEdgesPending = false;
+    jobPool.setMaxThreadCount(1);
+    connect(&jobWatcher, &QFutureWatcher<void>::finished, this, &MainWindow::jobFinished);
+    connect(this, &MainWindow::jobProgress, this, &MainWindow::showJobProgress, Qt::QueuedConnection);
 }
 
 MainWindow::~MainWindow() {
     qDebug() << "✗✗ MainWindow destructor";
+
+    disconnect(&jobWatcher, nullptr, this, nullptr);
+    cancelRequested.storeRelease(1);
+    jobWatcher.waitForFinished();
+    delete job;
+
     delete ui;
 
-    meshes.clear();
-    meshes.squeeze();
+    levels.clear();
 }
 
 void MainWindow::loadOBJ() {
-    OBJFile newModel = OBJFile(QFileDialog::getOpenFileName(this, "Import OBJ File", "models/", tr("Obj Files (*.obj)")));
-    meshes.clear();
-    meshes.squeeze();
-    meshes.append( Mesh(&newModel) );
-
-    ui->MainDisplay->updateBuffers( meshes[0]);
-    ui->MainDisplay->settings.modelLoaded = true;
-    ui->MainDisplay->mr.selectedVertex = -1;
-    ui->MainDisplay->update();
+    QString fileName = QFileDialog::getOpenFileName(this, "Import OBJ File", "models/", tr("Obj Files (*.obj);;Mesh Files (*.lsdmesh)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    // Drops whatever was still to be done for the previous model.
+    pendingFile = fileName;
+    if (job) {
+        cancelRequested.storeRelease(1);
+    }
+    runNextJob();
+}
+
+// A level request waits for a running load, but replaces a running level job:
+// that one stops at its next step and the latest request runs after it.
+void MainWindow::requestLevel(bool keepHalfEdges) {
+    levelPending = true;
+    keepHalfEdgesPending = keepHalfEdgesPending || keepHalfEdges;
+    if (job && !job->isLoad()) {
+        cancelRequested.storeRelease(1);
+    }
+    runNextJob();
+}
+
+// Levels that still have their GPU buffers are shown right away.
+void MainWindow::changeLevel() {
+    int level = ui->SubdivSteps->value();
+    bool loading = !pendingFile.isEmpty() || (job && job->isLoad());
+
+    if (loading || !ui->MainDisplay->hasLevel(level)) {
+        requestLevel();
+        return;
+    }
+
+    levelPending = false;
+    keepHalfEdgesPending = false;
+    if (job) {
+        cancelRequested.storeRelease(1);
+    }
+    ui->MainDisplay->showLevel(level);
+    showCacheUsage();
+}
+
+void MainWindow::runNextJob() {
+    if (job) {
+        return;
+    }
+
+    if (!pendingFile.isEmpty()) {
+        job = new MeshJob(pendingFile, quint64(ui->cacheBudget->value()) << 20);
+        pendingFile.clear();
+        // The new model is shown at the current level.
+        levelPending = true;
+    } else if (levelPending && !levels.isEmpty()) {
+        job = new MeshJob(levels, ui->SubdivSteps->value(), ui->MainDisplay->settings.limitSurface,
+                          ui->MainDisplay->settings.normalWeighting, keepHalfEdgesPending);
+        levelPending = false;
+        keepHalfEdgesPending = false;
+    } else {
+        ui->jobProgressBar->setValue(0);
+        ui->jobProgressBar->setFormat("Idle");
+        ui->cancelJob->setEnabled(false);
+        return;
+    }
+
+    cancelRequested.storeRelease(0);
+    ui->cancelJob->setEnabled(true);
+
+    MeshJob* running = job;
+    jobWatcher.setFuture(QtConcurrent::run(&jobPool, [this, running]() {
+        running->run(cancelRequested, [this](int percent, const QString& step) {
+            emit jobProgress(percent, step);
+        });
+    }));
+}
+
+void MainWindow::showJobProgress(int percent, QString step) {
+    if (job) {
+        ui->jobProgressBar->setValue(percent);
+        ui->jobProgressBar->setFormat(step + " (%p%)");
+    }
+}
+
+// Back on the GUI thread: the levels the job made are kept, even when it was
+// cancelled (except for a load, which would replace the displayed model), and
+// its attributes are uploaded unless a newer request superseded them.
+void MainWindow::jobFinished() {
+    MeshJob* done = job;
+    bool superseded = cancelRequested.loadAcquire() != 0;
+    job = nullptr;
+
+    if (done->isLoad()) {
+        if (done->finished) {
+            levels = done->cache;
+            ui->MainDisplay->mr.clearSelection();
+            // The old model stays on screen until the new one is uploaded.
+            ui->MainDisplay->releaseLevels(true);
+            ui->MainDisplay->updateCage(levels.level(0));
+        }
+    } else {
+        levels = done->cache;
+        if (done->finished && !superseded) {
+            ui->MainDisplay->updateBuffers(done->level, done->vertexCoords, done->vertexNormals, done->polyIndices, done->edgeIndices, done->bvh);
+            ui->MainDisplay->settings.modelLoaded = true;
+            ui->MainDisplay->update();
+        }
+    }
+    delete done;
+
+    // The budget may have changed while the job ran.
+    levels.setBudget(quint64(ui->cacheBudget->value()) << 20);
+    showCacheUsage();
+
+    runNextJob();
+}
+
+void MainWindow::on_cancelJob_clicked() {
+    pendingFile.clear();
+    levelPending = false;
+    keepHalfEdgesPending = false;
+    if (job) {
+        cancelRequested.storeRelease(1);
+    }
 }
 
 void MainWindow::on_selectionMode_currentIndexChanged(int index) {
     ui->MainDisplay->settings.selectionMode = index;
-    ui->MainDisplay->mr.selectedVertex = -1;
+    ui->MainDisplay->mr.clearSelection();
     ui->MainDisplay->mr.pointUpdated = false;
     ui->MainDisplay->update();
 }
@@ -43,6 +175,38 @@ void MainWindow::on_drawReflectionLines_toggled(bool checked) {
     ui->MainDisplay->update();
 }
 
+void MainWindow::on_limitSurface_toggled(bool checked) {
+    ui->MainDisplay->settings.limitSurface = checked;
+
+    if (ui->MainDisplay->settings.modelLoaded) {
+        changeLevel();
+    }
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_normalWeighting_currentIndexChanged(int index) {
+    ui->MainDisplay->settings.normalWeighting = NormalWeighting(index);
+
+    if (ui->MainDisplay->settings.modelLoaded) {
+        changeLevel();
+    }
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_compactVertices_toggled(bool checked) {
+    ui->MainDisplay->settings.compactVertices = checked;
+
+    if (ui->MainDisplay->settings.modelLoaded) {
+        changeLevel();
+    }
+    ui->MainDisplay->update();
+}
+
+void MainWindow::on_showCage_toggled(bool checked) {
+    ui->MainDisplay->settings.showCage = checked;
+    ui->MainDisplay->update();
+}
+
 void MainWindow::on_reflectionLinesDensity_valueChanged(int value) {
     ui->MainDisplay->settings.reflectionLinesDensity = value;
     ui->MainDisplay->update();
@@ -54,16 +218,9 @@ void MainWindow::on_glPointSize_valueChanged(int value) {
 }
 
 void MainWindow::on_SubdivSteps_valueChanged(int value) {
-    unsigned short k;
-    for (k = meshes.size(); k < value + 1; k++) {
-        meshes.append(Mesh());
-        //meshes.append(meshes[k-1].subdivideLoop());
-        meshes[k-1].subdivideLoop(meshes[k]);
-    }
-
     //ui->MainDisplay->setSubdivisionLevel(int value);
-    ui->MainDisplay->mr.selectedVertex = -1;
-    ui->MainDisplay->updateBuffers( meshes[value] );
+    ui->MainDisplay->mr.clearSelection();
+    changeLevel();
     ui->MainDisplay->update();
 }
 
@@ -87,3 +244,64 @@ void MainWindow::on_LoadOBJ_clicked() {
     ui->LoadOBJ->setEnabled(true);
     ui->SubdivSteps->setEnabled(true);
 }
+
+// Only the vertices of the base mesh are control points. Vertex points keep the
+// index of their vertex, so they have the same index on every level.
+void MainWindow::on_MainDisplay_selectedVertexDragged(unsigned int v, QVector3D displacement) {
+    if (job || levels.isEmpty() || v >= levels.level(0).numVertices()) {
+        return;
+    }
+
+    QVector<unsigned int> changed;
+    int level = ui->SubdivSteps->value();
+
+    // The level was only displayed. Its HalfEdges are built in the background,
+    // dragging works once they are there.
+    if (!levels.isResident(level)) {
+        requestLevel(true);
+        return;
+    }
+
+    // Only attributes that are there can be updated in place.
+    bool incremental = levels.level(level).hasAttributes(ui->MainDisplay->settings.limitSurface, ui->MainDisplay->settings.normalWeighting);
+
+    levels.moveVertex(v, levels.level(0).coords(v) + displacement, level, changed);
+    // The buffers of the other levels show the old shape.
+    ui->MainDisplay->releaseLevels(true);
+    if (changed.isEmpty() || !incremental) {
+        // An evicted level was in the way, so the level was recomputed.
+        ui->MainDisplay->updateBuffers(level, levels.level(level));
+        levels.trim(level);
+    } else {
+        ui->MainDisplay->updateVertices(levels.level(level), changed);
+    }
+    ui->MainDisplay->updateCage(levels.level(0));
+    showCacheUsage();
+}
+
+void MainWindow::on_cacheBudget_valueChanged(int value) {
+    levels.setBudget(quint64(value) << 20);
+    levels.trim(ui->SubdivSteps->value());
+    showCacheUsage();
+}
+
+void MainWindow::on_gpuBudget_valueChanged(int value) {
+    ui->MainDisplay->setGpuBudget(quint64(value) << 20);
+    showCacheUsage();
+}
+
+void MainWindow::showCacheUsage() {
+    QString resident;
+    for (unsigned int l = 0; l < levels.numLevels(); l++) {
+        if (levels.isResident(l)) {
+            resident += QString(" %1").arg(l);
+        }
+    }
+
+    ui->cacheUsage->setText(QString("%1 of %2 MB used\nLevels:%3\nGPU: %4 of %5 MB")
+                            .arg(levels.bytes() / 1048576.0, 0, 'f', 1)
+                            .arg(levels.budget() >> 20)
+                            .arg(resident)
+                            .arg(ui->MainDisplay->gpuBytes() / 1048576.0, 0, 'f', 1)
+                            .arg(ui->gpuBudget->value()));
+}
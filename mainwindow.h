@@ -6,6 +6,12 @@
 #include <QFileDialog>
 #include "mesh.h"
 #include "meshtools.h"
+#include "levelcache.h"
+#include "meshjob.h"
+
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QtConcurrent>
 
 namespace Ui {
 class MainWindow;
@@ -20,13 +26,21 @@ public:
     ~MainWindow();
 
     void loadOBJ();
-    QVector<Mesh> meshes;
+    LevelCache levels;
+
+signals:
+    // From the worker thread.
+    void jobProgress(int percent, QString step);
 
 private slots:
     void on_RotateDial_valueChanged(int value);
     void on_SubdivSteps_valueChanged(int value);
     void on_glPointSize_valueChanged(int value);
     void on_drawReflectionLines_toggled(bool checked);
+    void on_limitSurface_toggled(bool checked);
+    void on_normalWeighting_currentIndexChanged(int index);
+    void on_compactVertices_toggled(bool checked);
+    void on_showCage_toggled(bool checked);
     void on_selectionMode_currentIndexChanged(int index);
     void on_reflectionLinesDensity_valueChanged(int value);
 
@@ -35,9 +49,31 @@ private slots:
     void on_reflectionLinesNormalZ_valueChanged(int value);
 
     void on_LoadOBJ_clicked();
+    void on_cacheBudget_valueChanged(int value);
+    void on_gpuBudget_valueChanged(int value);
+    void on_cancelJob_clicked();
+
+    void showJobProgress(int percent, QString step);
+    void jobFinished();
+    void on_MainDisplay_selectedVertexDragged(unsigned int v, QVector3D displacement);
 
 private:
+    void requestLevel(bool keepHalfEdges = false);
+    void changeLevel();
+    void runNextJob();
+    void showCacheUsage();
+
     Ui::MainWindow *ui;
+
+    // Loading and subdividing run as MeshJobs on jobPool, one at a time. Only
+    // the latest request of each kind waits for the running job.
+    QThreadPool jobPool;
+    QFutureWatcher<void> jobWatcher;
+    MeshJob* job;
+    QAtomicInt cancelRequested;
+    QString pendingFile;
+    bool levelPending;
+    bool keepHalfEdgesPending;
 };
 
 #endif // MAINWINDOW_H
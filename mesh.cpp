@@ -1,14 +1,33 @@
 #include "mesh.h"
+#include "meshtools.h"
 #include "math.h"
+#include "parallel.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+const unsigned int Mesh::NoIndex;
 
 Mesh::Mesh() {
     qDebug() << "✓✓ Mesh constructor (Empty)";
+
+    implicitTriangles = false;
+    implicitHalfEdges = 0;
+    attributesValid = false;
+    attributesLimit = false;
+    attributesWeighting = NormalWeighting::Angle;
 }
 
-Mesh::Mesh(OBJFile* loadedOBJFile) {
+Mesh::Mesh(OBJFile* loadedOBJFile, bool useImplicitTriangles) {
 
     qDebug() << "✓✓ Mesh constructor (OBJ)";
 
+    attributesValid = false;
+    attributesLimit = false;
+    attributesWeighting = NormalWeighting::Angle;
+
     // Convert loaded OBJ file to HalfEdge mesh
     unsigned int numVertices, numHalfEdges, numFaces;
 
@@ -21,284 +40,545 @@ Mesh::Mesh(OBJFile* loadedOBJFile) {
 
     numFaces = loadedOBJFile->faceValences.size();
 
-    // Note - resize() invokes the Vertex() constructor, reserve() does not.
-    vertices.reserve(numVertices);
-    // If boundaries are present, reserve twice as much = worst case scenario
-    halfEdges.reserve(2*numHalfEdges);
-    faces.reserve(numFaces);
+    // Implicit connectivity is only possible if every face is a triangle.
+    implicitTriangles = useImplicitTriangles && numHalfEdges == 3*numFaces;
+    implicitHalfEdges = 0;
+
+    for (unsigned int k = 0; implicitTriangles && k < numFaces; k++) {
+        implicitTriangles = loadedOBJFile->faceValences[k] == 3;
+    }
+
+    if (implicitTriangles) {
+        qDebug() << "   * Using implicit triangle connectivity";
+        implicitHalfEdges = numHalfEdges;
+    }
+
+    resizeVertices(numVertices);
+    if (!implicitTriangles) {
+        resizeFaces(numFaces);
+    }
 
     // Add Vertices
 
-    for (int k = 0; k < numVertices; k++) {
-        // Coords (x,y,z), Out, Valence, Index
-        vertices.append(Vertex(loadedOBJFile->vertexCoords[k],
-                               nullptr,
-                               0,
-                               k));
+    for (unsigned int k = 0; k < numVertices; k++) {
+        vertexX[k] = loadedOBJFile->vertexCoords[k].x();
+        vertexY[k] = loadedOBJFile->vertexCoords[k].y();
+        vertexZ[k] = loadedOBJFile->vertexCoords[k].z();
         // Out and valence are unknown at this point.
+        vertexOut[k] = NoIndex;
+        vertexVal[k] = 0;
     }
 
-    qDebug() << "   # Vertices" << vertices.capacity() << vertices.size();
+    qDebug() << "   # Vertices" << vertexOut.capacity() << vertexOut.size();
 
     unsigned int indexH = 0;
     unsigned int currentIndex = 0;
 
-    // Initialize every entry of PotentialTwins with an empty QVector (using resize() )
-    QVector<QVector<unsigned int>> potentialTwins = QVector<QVector<unsigned int>>(loadedOBJFile->vertexCoords.size());
-    //potentialTwins.resize(loadedOBJFile->vertexCoords.size());
+    halfEdgeTarget.resize(numHalfEdges);
+    halfEdgeTwin.resize(numHalfEdges);
+    if (!implicitTriangles) {
+        halfEdgeNext.resize(numHalfEdges);
+        halfEdgeFace.resize(numHalfEdges);
+    }
 
     // Add Faces and most of the HalfEdges
-    unsigned int n;
+    unsigned int n, val, tail;
     for (unsigned int m = 0; m < numFaces; m++) {
-        // Side, Val, Index
-        faces.append(Face(nullptr,
-                          loadedOBJFile->faceValences[m],
-                          m));
-
-        for (n = 0; n < loadedOBJFile->faceValences[m]; n++) {
-            // Target, Next, Prev, Twin, Poly, Index
-            halfEdges.append(HalfEdge(&vertices[loadedOBJFile->faceCoordInd[currentIndex+n]],
-                    nullptr,
-                    nullptr,
-                    nullptr,
-                    &faces[m],
-                    indexH));
-
-            // Next, Prev and Twin of the above HalfEdge have to be assigned later! Starting below...
-
-            if (n > 0) {
-                halfEdges[indexH-1].next = &halfEdges[indexH];
-                halfEdges[indexH].prev = &halfEdges[indexH-1];
-
-                // Append index of HalfEdge to list of OutgoingHalfEdges of its TailVertex.
-                potentialTwins[loadedOBJFile->faceCoordInd[currentIndex+n-1]].append(indexH);
+        val = loadedOBJFile->faceValences[m];
+
+        for (n = 0; n < val; n++) {
+            halfEdgeTarget[indexH] = loadedOBJFile->faceCoordInd[currentIndex+n];
+            // Twin is assigned later.
+            halfEdgeTwin[indexH] = NoIndex;
+
+            if (!implicitTriangles) {
+                // The last HalfEdge of the face closes the loop.
+                halfEdgeNext[indexH] = n + 1 < val ? indexH + 1 : indexH + 1 - val;
+                halfEdgeFace[indexH] = m;
             }
-            indexH++;
-        }
 
-        // HalfEdges[indexH-1] is the most recent addition.
-        faces[m].side = &halfEdges[indexH-1];
+            // The first HalfEdge leaving a vertex becomes its out. Valence counts the
+            // outgoing HalfEdges, boundary ones are added by setTwins.
+            tail = loadedOBJFile->faceCoordInd[currentIndex + (n > 0 ? n : val) - 1];
+            if (vertexOut[tail] == NoIndex) {
+                vertexOut[tail] = indexH;
+            }
+            vertexVal[tail]++;
 
-        halfEdges[indexH-1].next = &halfEdges[indexH-n];
-        halfEdges[indexH-n].prev = &halfEdges[indexH-1];
+            indexH++;
+        }
 
-        potentialTwins[loadedOBJFile->faceCoordInd[currentIndex+n-1]].append(indexH-n);
+        if (!implicitTriangles) {
+            // HalfEdge indexH-1 is the most recent addition.
+            faceSide[m] = indexH-1;
+            faceVal[m] = val;
+        }
 
-        currentIndex += loadedOBJFile->faceValences[m];
+        currentIndex += val;
     }
 
-    qDebug() << "   # Faces" << faces.capacity() << faces.size();
-    qDebug() << "   # HalfEdges" << halfEdges.capacity() << halfEdges.size();
+    qDebug() << "   # Faces" << this->numFaces();
+    qDebug() << "   # HalfEdges" << halfEdgeTarget.capacity() << halfEdgeTarget.size();
 
-    // Outs and Valences of vertices
-    for (int k = 0; k < vertices.size(); k++) {
-        if (potentialTwins[k].size() == 0) {
-            qWarning() << " ! Isolated Vertex? PotentialTwins empty for Index" << k;
-            dispVertInfo(vertices[k]);
-            continue;
+    for (unsigned int k = 0; k < numVertices; k++) {
+        if (vertexOut[k] == NoIndex) {
+            qWarning() << " ! Isolated Vertex? No outgoing HalfEdges for Index" << k;
+            dispVertInfo(k);
         }
-        vertices[k].out = &halfEdges[potentialTwins[k][0]];
-        // Not the correct valence when on the boundary! Fixed below.
-        vertices[k].val = potentialTwins[k].size();
     }
 
-    setTwins(numHalfEdges, indexH, potentialTwins);
-
+    setTwins();
 
-    qDebug() << "   # Updated HalfEdges" << halfEdges.capacity() << halfEdges.size();
+    qDebug() << "   # Updated HalfEdges" << halfEdgeTarget.capacity() << halfEdgeTarget.size();
 }
 
 Mesh::~Mesh() {
     qDebug() << "✗✗ Mesh destructor";
 
-    qDebug() << "   # Vertices:" << vertices.size();
-    qDebug() << "   # HalfEdges:" << halfEdges.size();
-    qDebug() << "   # Faces:" << faces.size();
+    qDebug() << "   # Vertices:" << numVertices();
+    qDebug() << "   # HalfEdges:" << numHalfEdges();
+    qDebug() << "   # Faces:" << numFaces();
+}
 
-    vertices.clear();
-    vertices.squeeze();
-    halfEdges.clear();
-    halfEdges.squeeze();
-    faces.clear();
-    faces.squeeze();
+void Mesh::resizeVertices(unsigned int n) {
+    attributesValid = false;
+    vertexX.resize(n);
+    vertexY.resize(n);
+    vertexZ.resize(n);
+    vertexOut.resize(n);
+    vertexVal.resize(n);
 }
 
-void Mesh::extractAttributes() {
-    unsigned int k;
-    unsigned short m;
-    HalfEdge* currentEdge;
+void Mesh::setCoords(const QVector<QVector3D>& positions) {
+    const QVector3D* in = positions.constData();
+    attributesValid = false;
+    float* x = vertexX.data();
+    float* y = vertexY.data();
+    float* z = vertexZ.data();
+
+    parallelFor(qMin(numVertices(), unsigned(positions.size())), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            x[k] = in[k].x();
+            y[k] = in[k].y();
+            z[k] = in[k].z();
+        }
+    });
+}
 
-    vertexCoords.clear();
-    vertexCoords.reserve(vertices.size());
+// Set implicitTriangles and implicitHalfEdges first.
+void Mesh::resizeHalfEdges(unsigned int n) {
+    halfEdgeTarget.resize(n);
+    halfEdgeTwin.resize(n);
+    halfEdgeNext.resize(n - implicitHalfEdges);
+    halfEdgeFace.resize(n - implicitHalfEdges);
+}
 
-    for (k = 0; k < vertices.size(); k++) {
-        vertexCoords.append(vertices[k].coords);
-    }
+void Mesh::resizeFaces(unsigned int n) {
+    faceSide.resize(n);
+    faceVal.resize(n);
+}
 
-    vertexNormals.clear();
-    vertexNormals.reserve(vertices.size());
+template<class T> static quint64 capacityBytes(const QVector<T>& array) {
+    return quint64(array.capacity()) * sizeof(T);
+}
 
-    for (k = 0; k < faces.size(); k++) {
-        setFaceNormal(faces[k]);
+void Mesh::unshare() {
+    vertexX.data();
+    vertexY.data();
+    vertexZ.data();
+    vertexCoords.data();
+    vertexNormals.data();
+    faceNormals.data();
+}
+
+quint64 Mesh::memoryBytes() const {
+    return sizeof(Mesh)
+            + capacityBytes(vertexCoords) + capacityBytes(vertexNormals)
+            + capacityBytes(polyIndices) + capacityBytes(edgeIndices)
+            + capacityBytes(vertexX) + capacityBytes(vertexY) + capacityBytes(vertexZ)
+            + capacityBytes(vertexOut) + capacityBytes(vertexVal)
+            + capacityBytes(halfEdgeTarget) + capacityBytes(halfEdgeNext)
+            + capacityBytes(halfEdgeTwin) + capacityBytes(halfEdgeFace)
+            + capacityBytes(faceSide) + capacityBytes(faceVal) + capacityBytes(faceNormals);
+}
+
+// Every pass writes each vertex or face from one iteration only, so all of them
+// run in parallel. The arrays they write are detached before, and the threads
+// read the mesh through its const accessors only: detaching from several
+// threads at once, e.g. while a MeshJob still shares the arrays, is a race.
+void Mesh::extractAttributes(bool limitSurface, NormalWeighting weighting) {
+    unsigned int numVerts = numVertices();
+    unsigned int numFaces = this->numFaces();
+    const Mesh& mesh = *this;
+
+    if (hasAttributes(limitSurface, weighting)) {
+        return;
     }
 
-    for (k = 0; k < vertices.size(); k++) {
-        vertexNormals.append(computeVertexNormal(vertices[k]) );
+    vertexCoords.clear();
+    vertexCoords.resize(numVerts);
+    vertexNormals.clear();
+    vertexNormals.resize(numVerts);
+    QVector3D* points = vertexCoords.data();
+    QVector3D* normals = vertexNormals.data();
+
+    if (limitSurface) {
+        parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                if (mesh.out(k) == NoIndex) {
+                    points[k] = mesh.coords(k);
+                    normals[k] = QVector3D();
+                } else {
+                    points[k] = limitPoint(mesh, mesh.out(k));
+                    normals[k] = limitNormal(mesh, mesh.out(k));
+                }
+            }
+        });
+    } else {
+        // Area works from the corners alone and needs no face normals.
+        if (weighting == NormalWeighting::Area) {
+            faceNormals.clear();
+            faceNormals.squeeze();
+        } else {
+            faceNormals.resize(numFaces);
+            QVector3D* faces = faceNormals.data();
+            parallelFor(numFaces, [&](unsigned int begin, unsigned int end) {
+                for (unsigned int k = begin; k < end; k++) {
+                    faces[k] = mesh.computeFaceNormal(k, weighting);
+                }
+            });
+        }
+
+        parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                points[k] = mesh.coords(k);
+                normals[k] = mesh.computeVertexNormal(k, weighting);
+            }
+        });
     }
 
     polyIndices.clear();
-    polyIndices.reserve(halfEdges.size() + faces.size());
+    polyIndices.resize(3 * numFaces);
+    unsigned int* triangles = polyIndices.data();
+
+    parallelFor(numFaces, [&](unsigned int begin, unsigned int end) {
+        unsigned int currentEdge;
+        for (unsigned int k = begin; k < end; k++) {
+            currentEdge = mesh.side(k);
+            for (unsigned short m = 0; m < 3; m++) {
+                triangles[3*k + m] = mesh.target(currentEdge);
+                currentEdge = mesh.next(currentEdge);
+            }
+        }
+    });
+
+    extractEdges(edgeIndices);
+
+    attributesValid = true;
+    attributesLimit = limitSurface;
+    attributesWeighting = weighting;
+}
 
-    for (k = 0; k < faces.size(); k++) {
-        currentEdge = faces[k].side;
-        for (m = 0; m < 3; m++) {
-            polyIndices.append(currentEdge->target->index);
-            currentEdge = currentEdge->next;
+void Mesh::updateAttributes(const QVector<unsigned int>& moved, bool limitSurface, NormalWeighting weighting, QVector<unsigned int>& updated) {
+    QVector<unsigned int> faces;
+    unsigned int currentEdge;
+    const Mesh& mesh = *this;
+
+    updated.clear();
+    for (int k = 0; k < moved.size(); k++) {
+        updated.append(moved[k]);
+        currentEdge = out(moved[k]);
+        for (unsigned short m = 0; currentEdge != NoIndex && m < valence(moved[k]); m++) {
+            updated.append(target(currentEdge));
+            if (face(currentEdge) != NoIndex) {
+                faces.append(face(currentEdge));
+            }
+            currentEdge = next(twin(currentEdge));
         }
     }
-}
 
-void Mesh::setTwins(unsigned int numHalfEdges, unsigned int indexH, QVector<QVector<unsigned int>>& potentialTwins) {
-    unsigned int hTail, hHead, len, n;
-    QSet<unsigned int> twinless;
-
-    HalfEdge* he;
-    // Assign Twins
-    for (unsigned int m = 0; m < numHalfEdges; m++) {
-        he = &halfEdges[m];
-        if (not he->twin) {
-            hTail = he->prev->target->index;
-            hHead = he->target->index;
-            len = he->target->val;
-            for (n = 0; n < len; n++) {
-                if (halfEdges[potentialTwins[hHead][n]].target->index == hTail) {
-                    //qDebug() << "Found Twin!";
-                    halfEdges[m].twin = &halfEdges[potentialTwins[hHead][n]];
-                    halfEdges[potentialTwins[hHead][n]].twin = he;
-                    break;
-                }
+    std::sort(updated.begin(), updated.end());
+    updated.erase(std::unique(updated.begin(), updated.end()), updated.end());
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+
+    // Every face and vertex is written by one iteration only, see extractAttributes.
+    bool withFaceNormals = !limitSurface && weighting != NormalWeighting::Area;
+    if (withFaceNormals) {
+        faceNormals.resize(numFaces());
+    }
+    unshare();
+    QVector3D* faceOut = faceNormals.data();
+    QVector3D* points = vertexCoords.data();
+    QVector3D* normals = vertexNormals.data();
+
+    if (withFaceNormals) {
+        parallelFor(faces.size(), [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                faceOut[faces[k]] = mesh.computeFaceNormal(faces[k], weighting);
             }
-            if (n == len) {
-                // Twin not found...
-                twinless.insert(m);
+        }, 256);
+    }
+
+    parallelFor(updated.size(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            unsigned int v = updated[k];
+            if (!limitSurface) {
+                points[v] = mesh.coords(v);
+                normals[v] = mesh.computeVertexNormal(v, weighting);
+            } else if (mesh.out(v) != NoIndex) {
+                points[v] = limitPoint(mesh, mesh.out(v));
+                normals[v] = limitNormal(mesh, mesh.out(v));
             }
         }
+    }, 256);
+
+    attributesValid = attributesLimit == limitSurface && (limitSurface || attributesWeighting == weighting);
+}
+
+bool Mesh::writeOBJ(QString fileName) {
+    QFile outFile(fileName);
+
+    if (!outFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << " ! Could not open" << fileName << "for writing";
+        return false;
     }
 
-    if (twinless.size() > 0) {
-        // The mesh is not closed
-        qDebug() << " * There are" << twinless.size() << "HalfEdges without Twin (i.e. the model contains boundaries)";
-        //qDebug() << Twinless.values();
-
-        HalfEdge* initialEdge;
-        HalfEdge* currentEdge;
-        unsigned int startBoundaryLoop;
-
-        while (twinless.size() > 0) {
-            // Select a HalfEdge without Twin. The Twin that we will create is part of a boundary edge loop
-            qDebug() << " → Processing new Boundary Edge Loop";
-
-            initialEdge = &halfEdges[*twinless.begin()];
-            twinless.remove(initialEdge->index);
-
-            // Target, Next, Prev, Twin, Poly, Index
-            halfEdges.append(HalfEdge( initialEdge->prev->target,
-                                       nullptr,
-                                       nullptr,
-                                       initialEdge,
-                                       nullptr,
-                                       indexH ));
-            startBoundaryLoop = indexH;
-            // Twin of initialEdge should be assigned AFTER the central while loop!
-            indexH++;
+    QTextStream fileContents(&outFile);
+    unsigned int currentEdge;
 
-            // Use a sketch to properly understand these steps (assume counter-clockwise HalfEdges) :)
-            currentEdge = initialEdge->prev;
-            while (currentEdge->twin != nullptr) {
-                currentEdge = currentEdge->twin->prev;
-            }
+    // 9 significant digits read back as the same float; the default of 6
+    // merges the vertices of fine levels and loses large coordinates.
+    fileContents.setRealNumberPrecision(9);
+
+    for (unsigned int k = 0; k < numVertices(); k++) {
+        fileContents << "v " << vertexX[k] << " " << vertexY[k] << " " << vertexZ[k] << "\n";
+    }
+
+    for (unsigned int k = 0; k < numFaces(); k++) {
+        fileContents << "f";
+        currentEdge = side(k);
+        for (unsigned short m = 0; m < faceValence(k); m++) {
+            // Note +1, OBJ starts indexing from 1.
+            fileContents << " " << halfEdgeTarget[currentEdge] + 1;
+            currentEdge = next(currentEdge);
+        }
+        fileContents << "\n";
+    }
+
+    fileContents.flush();
+    bool ok = fileContents.status() == QTextStream::Ok;
+    outFile.close();
+    ok = ok && outFile.error() == QFileDevice::NoError;
+
+    if (!ok) {
+        qWarning() << " ! Could not write" << fileName;
+    }
+
+    return ok;
+}
 
-            // Trace the current boundary loop
-            while (currentEdge != initialEdge) {
-                twinless.remove(currentEdge->index);
-                // Target, Next, Prev, Twin, Poly, Index
-                halfEdges.append(HalfEdge( currentEdge->prev->target,
-                                           nullptr,
-                                           &halfEdges[indexH-1],
-                                 currentEdge,
-                                 nullptr,
-                                 indexH ));
-                halfEdges[indexH-1].next = &halfEdges[indexH];
-
-                currentEdge->target->val += 1;
-                currentEdge->twin = &halfEdges[indexH];
-                indexH++;
-
-                currentEdge = currentEdge->prev;
-                while (currentEdge->twin != nullptr) {
-                    currentEdge = currentEdge->twin->prev;
+// Matches the face HalfEdges by sorting them on their (lowest, highest) vertex
+// pair; twins end up next to each other. HalfEdges left without twin get a
+// boundary twin, appended in the order of the face HalfEdge it belongs to.
+void Mesh::setTwins() {
+    unsigned int numHalfEdges = this->numHalfEdges();
+    unsigned int numChunks = parallelChunks(numHalfEdges);
+    unsigned int vertexBits = 1;
+
+    while (vertexBits < 32 && (1ull << vertexBits) < numVertices()) {
+        vertexBits++;
+    }
+
+    const Mesh& mesh = *this;
+    QVector<quint64> edgeKey(numHalfEdges);
+    QVector<unsigned int> sortedEdge(numHalfEdges);
+    quint64* edgeKeys = edgeKey.data();
+    unsigned int* sortedEdges = sortedEdge.data();
+    unsigned int* twins = halfEdgeTwin.data();
+
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        unsigned int a, b;
+        for (unsigned int m = begin; m < end; m++) {
+            a = mesh.target(mesh.prev(m));
+            b = mesh.target(m);
+            edgeKeys[m] = (quint64(qMin(a, b)) << vertexBits) | qMax(a, b);
+            sortedEdges[m] = m;
+        }
+    });
+
+    parallelRadixSort(edgeKey, sortedEdge, 2 * vertexBits);
+
+    edgeKeys = edgeKey.data();
+    sortedEdges = sortedEdge.data();
+
+    // Every chunk handles the runs of equal keys starting in it. Normally a run is
+    // a single boundary HalfEdge or a pair of twins; on non-manifold edges each
+    // HalfEdge pairs with the first free one of opposite direction.
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        unsigned int runEnd, h, g;
+        for (unsigned int k = begin; k < end; k++) {
+            if (k > 0 && edgeKeys[k] == edgeKeys[k-1]) {
+                continue;
+            }
+            for (runEnd = k + 1; runEnd < numHalfEdges && edgeKeys[runEnd] == edgeKeys[k]; runEnd++);
+
+            for (unsigned int m = k; m < runEnd; m++) {
+                h = sortedEdges[m];
+                for (unsigned int n = m + 1; twins[h] == NoIndex && n < runEnd; n++) {
+                    g = sortedEdges[n];
+                    if (twins[g] == NoIndex && mesh.target(g) != mesh.target(h)) {
+                        twins[h] = g;
+                        twins[g] = h;
+                    }
                 }
             }
+        }
+    });
 
-            halfEdges[startBoundaryLoop].prev = &halfEdges[indexH-1];
-            halfEdges[indexH-1].next = &halfEdges[startBoundaryLoop];
+    // Boundary HalfEdges, numbered per chunk like the edge points in subdivideLoop.
+    QVector<unsigned int> chunkStart(numChunks + 1);
+    unsigned int* chunkStarts = chunkStart.data();
 
-            initialEdge->target->val += 1;
-            // Set Twin of initialEdge!
-            initialEdge->twin = &halfEdges[startBoundaryLoop];
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int count = 0;
+        for (unsigned int m = begin; m < end; m++) {
+            count += twins[m] == NoIndex;
         }
+        chunkStarts[chunk + 1] = count;
+    });
+
+    chunkStart[0] = 0;
+    for (unsigned int c = 0; c < numChunks; c++) {
+        chunkStart[c + 1] += chunkStart[c];
+    }
+
+    unsigned int numBoundary = chunkStart[numChunks];
 
+    if (numBoundary == 0) {
+        return;
+    }
+
+    // The mesh is not closed
+    qDebug() << " * There are" << numBoundary << "HalfEdges without Twin (i.e. the model contains boundaries)";
+
+    resizeHalfEdges(numHalfEdges + numBoundary);
+
+    // Face HalfEdge of every boundary HalfEdge, in HalfEdge order.
+    QVector<unsigned int> boundaryTwin(numBoundary);
+    unsigned int* boundaryTwins = boundaryTwin.data();
+    unsigned int* targets = halfEdgeTarget.data();
+    unsigned int* nexts = halfEdgeNext.data();
+    unsigned int* faces = halfEdgeFace.data();
+    twins = halfEdgeTwin.data();
+
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int b = chunkStarts[chunk];
+        for (unsigned int m = begin; m < end; m++) {
+            if (twins[m] == NoIndex) {
+                boundaryTwins[b] = m;
+                b++;
+            }
+        }
+    });
+
+    // Target, Next, Twin, Face. Next is the boundary HalfEdge found by rotating
+    // around the tail of the face HalfEdge until a twinless one shows up (use a
+    // sketch, assuming counter-clockwise HalfEdges). Twins of the face HalfEdges
+    // are only assigned afterwards, so every boundary HalfEdge is independent.
+    parallelFor(numBoundary, [&](unsigned int begin, unsigned int end) {
+        unsigned int h, currentEdge, b;
+        for (unsigned int k = begin; k < end; k++) {
+            h = boundaryTwins[k];
+            b = numHalfEdges + k;
+
+            currentEdge = mesh.prev(h);
+            while (twins[currentEdge] != NoIndex) {
+                currentEdge = mesh.prev(twins[currentEdge]);
+            }
+
+            targets[b] = targets[mesh.prev(h)];
+            twins[b] = h;
+            faces[b - implicitHalfEdges] = NoIndex;
+            nexts[b - implicitHalfEdges] = numHalfEdges + (std::lower_bound(boundaryTwins, boundaryTwins + numBoundary, currentEdge) - boundaryTwins);
+        }
+    });
+
+    for (unsigned int k = 0; k < numBoundary; k++) {
+        twins[boundaryTwins[k]] = numHalfEdges + k;
+        // The boundary HalfEdge leaves the target of its twin.
+        vertexVal[targets[boundaryTwins[k]]]++;
     }
 }
 
-void Mesh::setFaceNormal(Face& currentFace) {
+QVector3D Mesh::computeFaceNormal(unsigned int f, NormalWeighting weighting) const {
     QVector3D faceNormal = QVector3D(0.0, 0.0, 0.0);
-    HalfEdge* currentEdge = currentFace.side;
+    unsigned int currentEdge = side(f);
+    QVector3D p;
+
+    // One corner of a triangle already gives twice its area times its unit normal.
+    if (weighting != NormalWeighting::Angle && faceValence(f) == 3) {
+        p = coords(target(currentEdge));
+        return QVector3D::crossProduct(
+                    coords(target(next(currentEdge))) - p,
+                    coords(target(twin(currentEdge))) - p );
+    }
 
-    for (unsigned int k = 0; k < currentFace.val; k++) {
+    for (unsigned int k = 0; k < faceValence(f); k++) {
+        p = coords(target(currentEdge));
         faceNormal += QVector3D::crossProduct(
-                    currentEdge->next->target->coords - currentEdge->target->coords,
-                    currentEdge->twin->target->coords - currentEdge->target->coords );
-        currentEdge = currentEdge->next;
+                    coords(target(next(currentEdge))) - p,
+                    coords(target(twin(currentEdge))) - p );
+        currentEdge = next(currentEdge);
     }
 
-    currentFace.normal = faceNormal / faceNormal.length();
+    return weighting == NormalWeighting::Angle ? faceNormal / faceNormal.length() : faceNormal;
 }
 
-QVector3D Mesh::computeVertexNormal(Vertex& currentVertex) {
+QVector3D Mesh::computeVertexNormal(unsigned int v, NormalWeighting weighting) const {
 
     QVector3D vertexNormal = QVector3D();
-    HalfEdge* currentEdge = currentVertex.out;
+    unsigned int currentEdge = out(v);
     float faceAngle;
-    QVector3D p = currentVertex.coords;
+    QVector3D p = coords(v);
 
-    // this will only work if all outgoing edges of currentvertex
-    // have a prev, next and a twin
-    for (int k = 0; k < currentVertex.val; k++) {
-
-        faceAngle = acos( fmax(-1.0, QVector3D::dotProduct(
-                                   (currentEdge->target->coords - p).normalized(),
-                                   (currentEdge->prev->twin->target->coords - p).normalized() ) ) );
+    if (currentEdge == NoIndex) {
+        return vertexNormal;
+    }
 
-        if (currentEdge->polygon) {
-            vertexNormal += faceAngle * currentEdge->polygon->normal;
+    // Boundary HalfEdges do not contribute, so prev() only walks face cycles.
+    for (int k = 0; k < valence(v); k++) {
+
+        if (face(currentEdge) == NoIndex) {
+            // Nothing to add
+        } else if (weighting == NormalWeighting::Fast) {
+            vertexNormal += faceNormals[face(currentEdge)];
+        } else if (weighting == NormalWeighting::Area) {
+            vertexNormal += QVector3D::crossProduct(coords(target(currentEdge)) - p,
+                                                    coords(target(twin(prev(currentEdge)))) - p);
+        } else {
+            faceAngle = acos( fmax(-1.0, QVector3D::dotProduct(
+                                       (coords(target(currentEdge)) - p).normalized(),
+                                       (coords(target(twin(prev(currentEdge)))) - p).normalized() ) ) );
+
+            vertexNormal += faceAngle * faceNormals[face(currentEdge)];
         }
 
-        currentEdge = currentEdge->twin->next;
+        currentEdge = next(twin(currentEdge));
 
     }
 
     return vertexNormal;
 }
 
-void Mesh::dispVertInfo(Vertex& dVert) {
-    qDebug() << "Vertex at Index =" << dVert.index << "Coords =" << dVert.coords << "Out =" << dVert.out << "Val =" << dVert.val;
+void Mesh::dispVertInfo(unsigned int v) {
+    qDebug() << "Vertex at Index =" << v << "Coords =" << coords(v) << "Out =" << vertexOut[v] << "Val =" << vertexVal[v];
 }
 
-void Mesh::dispHalfEdgeInfo(HalfEdge& dHalfEdge) {
-    qDebug() << "HalfEdge at Index =" << dHalfEdge.index << "Target =" << dHalfEdge.target << "Next =" << dHalfEdge.next << "Prev =" << dHalfEdge.prev << "Twin =" << dHalfEdge.twin << "Poly =" << dHalfEdge.polygon;
+void Mesh::dispHalfEdgeInfo(unsigned int h) {
+    qDebug() << "HalfEdge at Index =" << h << "Target =" << halfEdgeTarget[h] << "Next =" << next(h) << "Twin =" << halfEdgeTwin[h] << "Face =" << face(h);
 }
 
-void Mesh::dispFaceInfo(Face& dFace){
-    qDebug() << "Face at Index =" << dFace.index << "Side =" << dFace.side << "Val =" << dFace.val;
+void Mesh::dispFaceInfo(unsigned int f){
+    qDebug() << "Face at Index =" << f << "Side =" << side(f) << "Val =" << faceValence(f);
 }
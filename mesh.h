@@ -2,49 +2,228 @@
 #define MESH_H
 
 #include <QVector>
-
-#include "vertex.h"
-#include "face.h"
-#include "halfedge.h"
+#include <QVector3D>
+#include <QDebug>
 
 #include "objfile.h"
 
+// HalfEdge mesh stored as a structure of arrays. Vertices, HalfEdges and Faces
+// are identified by their 32-bit index into the arrays below; all connectivity
+// is expressed in such indices, so the arrays can be copied and reallocated
+// freely. Boundary HalfEdges have no face (NoIndex).
+//
+// Triangle meshes can use implicit connectivity: HalfEdge 3f+i is side i of
+// face f, so next, prev and face of these are arithmetic and only target and
+// twin are stored. The boundary HalfEdges follow after the 3*numFaces face
+// HalfEdges and keep an explicit next (and face, always NoIndex), stored at
+// index h - implicitHalfEdges. Every level produced by subdivideLoop from such
+// a mesh uses the same layout.
+//
+// The layout is picked once, for the base mesh: implicit only if all of its
+// faces are triangles. subdivideLoop keeps the layout of its input, so a base
+// stored explicitly (Mesh(OBJFile*, false), --explicit) stays explicit at every
+// level. subdivideLoop splits every face as a triangle, so Loop subdivision
+// needs a triangle base in either layout; other polygons are not refined into
+// triangles first.
+
+// Point on triangle f: weight 1-u-v at the target of side(f), u at the next
+// corner and v at the one after that.
+struct FacePoint {
+    unsigned int face;
+    float u, v;
+};
+
+// How extractAttributes weighs the faces around a vertex in its normal. Angle
+// uses unit face normals times the angle of the corner at the vertex. Area
+// sums the cross products of the two edges at every corner, so larger faces
+// count more, without square roots or trigonometry. Fast computes the area
+// weighted face normals once per face and only adds them up per vertex.
+enum class NormalWeighting { Angle, Area, Fast };
+
 class Mesh {
 
 public:
     Mesh();
-    Mesh(OBJFile *loadedOBJFile);
+    Mesh(OBJFile *loadedOBJFile, bool useImplicitTriangles = true);
     ~Mesh();
 
-    inline QVector<Vertex>& getVertices() { return vertices; }
-    inline QVector<HalfEdge>& getHalfEdges() { return halfEdges; }
-    inline QVector<Face>& getFaces() { return faces; }
+    // Marks a missing Face or HalfEdge.
+    static const unsigned int NoIndex = 0xFFFFFFFF;
+
+    inline bool hasImplicitTriangles() const { return implicitTriangles; }
+
+    inline unsigned int numVertices() const { return vertexOut.size(); }
+    inline unsigned int numHalfEdges() const { return halfEdgeTarget.size(); }
+    inline unsigned int numFaces() const { return implicitTriangles ? implicitHalfEdges / 3 : faceSide.size(); }
+
+    // Vertices
+    inline QVector3D coords(unsigned int v) const { return QVector3D(vertexX[v], vertexY[v], vertexZ[v]); }
+    inline unsigned int out(unsigned int v) const { return vertexOut[v]; }
+    inline unsigned short valence(unsigned int v) const { return vertexVal[v]; }
+
+    // HalfEdges
+    inline unsigned int target(unsigned int h) const { return halfEdgeTarget[h]; }
+    inline unsigned int twin(unsigned int h) const { return halfEdgeTwin[h]; }
+    inline unsigned int next(unsigned int h) const {
+        if (h < implicitHalfEdges) {
+            return (h % 3 == 2) ? h - 2 : h + 1;
+        }
+        return halfEdgeNext[h - implicitHalfEdges];
+    }
+    inline unsigned int face(unsigned int h) const {
+        if (h < implicitHalfEdges) {
+            return h / 3;
+        }
+        return halfEdgeFace[h - implicitHalfEdges];
+    }
+    // Walks the cycle of h, only use this on short (face) cycles.
+    inline unsigned int prev(unsigned int h) const {
+        if (h < implicitHalfEdges) {
+            return (h % 3 == 0) ? h + 2 : h - 1;
+        }
+        unsigned int p = h;
+        while (next(p) != h) {
+            p = next(p);
+        }
+        return p;
+    }
+
+    // Faces
+    inline unsigned int side(unsigned int f) const { return implicitTriangles ? 3*f : faceSide[f]; }
+    inline unsigned short faceValence(unsigned int f) const { return implicitTriangles ? 3 : faceVal[f]; }
+
+    // Bytes held by this mesh: the object and the allocated capacity of all
+    // arrays, the render attributes included.
+    quint64 memoryBytes() const;
+
+    // Leaves the render attributes as they are, see invalidateAttributes.
+    inline void setCoords(unsigned int v, const QVector3D& p) {
+        vertexX[v] = p.x();
+        vertexY[v] = p.y();
+        vertexZ[v] = p.z();
+    }
+    // Moves all vertices at once (positions has numVertices() entries), e.g. to
+    // the result of a StencilTable. The connectivity stays as it is.
+    void setCoords(const QVector<QVector3D>& positions);
+
+    inline const float* getVertexX() const { return vertexX.constData(); }
+    inline const float* getVertexY() const { return vertexY.constData(); }
+    inline const float* getVertexZ() const { return vertexZ.constData(); }
 
     inline QVector<QVector3D>& getVertexCoords() { return vertexCoords; }
     inline QVector<QVector3D>& getVertexNorms() { return vertexNormals; }
     inline QVector<unsigned int>& getPolyIndices() { return polyIndices; }
+    // Two vertex indices per edge, for drawing with GL_LINES.
+    inline QVector<unsigned int>& getEdgeIndices() { return edgeIndices; }
+
+    // With limitSurface, the vertices are pushed to the Loop limit surface and get
+    // its exact normals instead of the weighted face normals. Does nothing if the
+    // attributes are still there from the last call.
+    void extractAttributes(bool limitSurface = false, NormalWeighting weighting = NormalWeighting::Angle);
+    inline bool hasAttributes(bool limitSurface, NormalWeighting weighting = NormalWeighting::Angle) const {
+        return attributesValid && attributesLimit == limitSurface && (limitSurface || attributesWeighting == weighting);
+    }
+    // After moving vertices with setCoords, the attributes are extracted again.
+    inline void invalidateAttributes() { attributesValid = false; }
+    // Copies of a mesh share their arrays until one of them writes (Qt's
+    // implicit sharing). Call this before writing coordinates or attributes
+    // from several threads at once; the threads then write through data()
+    // pointers taken before, and read only through const accessors, which
+    // never detach.
+    void unshare();
+    // Refreshes the attributes after the given vertices were moved: their
+    // positions, and the normals (limit points too, with limitSurface) of them
+    // and their neighbours, which are returned sorted in updated.
+    void updateAttributes(const QVector<unsigned int>& moved, bool limitSurface, NormalWeighting weighting, QVector<unsigned int>& updated);
+    // Every edge once (one entry per pair of twins), in the order of the edge
+    // points of subdivideLoop. extractAttributes fills getEdgeIndices with it.
+    void extractEdges(QVector<unsigned int>& edges) const;
+    bool writeOBJ(QString fileName);
+
+    // Positions and normals of the Loop limit surface at the given points, see
+    // limitsurface.h. Returns false if the mesh is not a triangle mesh. Points
+    // with face >= numFaces() get zeros, and u, v are clamped to the triangle
+    // (u, v >= 0, u + v <= 1).
+    bool evaluateLimit(const QVector<FacePoint>& points, QVector<QVector3D>& positions, QVector<QVector3D>& normals) const;
 
-    void extractAttributes();
+    // Binary mesh files (.lsdmesh) with the complete connectivity, see meshfile.cpp.
+    bool writeBinary(QString fileName);
+    bool readBinary(QString fileName);
 
-    void setTwins(unsigned int numHalfEdges, unsigned int indexH, QVector<QVector<unsigned int>>& potentialTwins);
-    void setFaceNormal(Face& currentFace);
-    QVector3D computeVertexNormal(Vertex& currentVertex);
+    void setTwins();
+    // Unit normal with Angle. Otherwise the sum of the cross products at the
+    // corners, for a triangle only one: twice its area times its unit normal.
+    QVector3D computeFaceNormal(unsigned int f, NormalWeighting weighting = NormalWeighting::Angle) const;
+    // Area does not use the face normals, the other two need the ones of
+    // computeFaceNormal with the same weighting in faceNormals first.
+    QVector3D computeVertexNormal(unsigned int v, NormalWeighting weighting = NormalWeighting::Angle) const;
 
     // For debugging
-    void dispVertInfo(Vertex& dVert);
-    void dispHalfEdgeInfo(HalfEdge& dHalfEdge);
-    void dispFaceInfo(Face& dFace);
+    void dispVertInfo(unsigned int v);
+    void dispHalfEdgeInfo(unsigned int h);
+    void dispFaceInfo(unsigned int f);
 
-    void subdivideLoop(Mesh& mesh);
-    void splitHalfEdges(QVector<Vertex>& newVertices, QVector<HalfEdge>& newHalfEdges);
+    void subdivideLoop(Mesh& mesh) const;
+    // Render attributes of the level subdivideLoop would make, as extractAttributes
+    // gives them without limitSurface, without building that level. Cheaper for
+    // a level that is only displayed and not refined further. There are no face
+    // normals to keep here, so Fast gives the normals of Area.
+    void subdivideLoopAttributes(QVector<QVector3D>& coords, QVector<QVector3D>& normals, QVector<unsigned int>& indices, QVector<unsigned int>& edges,
+                                 NormalWeighting weighting = NormalWeighting::Angle) const;
+    // Edge point of HalfEdge h in child, which subdivideLoop made from this mesh.
+    inline unsigned int childEdgePoint(const Mesh& child, unsigned int h) const { return child.target(firstHalf(h)); }
+    void splitHalfEdges(Mesh& mesh, const QVector<unsigned int>& edgeVertex) const;
+    void refineTriangles(Mesh& mesh, const QVector<unsigned int>& edgeVertex) const;
 private:
+    void resizeVertices(unsigned int n);
+    void resizeHalfEdges(unsigned int n);
+    void resizeFaces(unsigned int n);
+
+    inline void setNext(unsigned int h, unsigned int n) { halfEdgeNext[h - implicitHalfEdges] = n; }
+    void numberEdgePoints(QVector<unsigned int>& edgeVertex) const;
+    // Whether all indices are in range and the valences agree with the
+    // connectivity, for meshes read by readBinary.
+    bool checkConnectivity() const;
+
+    // Children of HalfEdge h after refineTriangles, starting at the tail resp. the target of h.
+    inline unsigned int firstHalf(unsigned int h) const {
+        if (h < implicitHalfEdges) {
+            return 3 * (4 * (h / 3) + (h + 2) % 3) + 1;
+        }
+        return 4 * implicitHalfEdges + 2 * (h - implicitHalfEdges);
+    }
+    inline unsigned int secondHalf(unsigned int h) const {
+        if (h < implicitHalfEdges) {
+            return 4 * h - h % 3;
+        }
+        return 4 * implicitHalfEdges + 2 * (h - implicitHalfEdges) + 1;
+    }
+
     QVector<QVector3D> vertexCoords;
     QVector<QVector3D> vertexNormals;
     QVector<unsigned int> polyIndices;
+    QVector<unsigned int> edgeIndices;
+    bool attributesValid;
+    bool attributesLimit;
+    NormalWeighting attributesWeighting;
+
+    // Vertices
+    QVector<float> vertexX, vertexY, vertexZ;
+    QVector<unsigned int> vertexOut;
+    QVector<unsigned short> vertexVal;
+
+    // HalfEdges, next and face start at implicitHalfEdges
+    bool implicitTriangles;
+    unsigned int implicitHalfEdges;
+    QVector<unsigned int> halfEdgeTarget;
+    QVector<unsigned int> halfEdgeNext;
+    QVector<unsigned int> halfEdgeTwin;
+    QVector<unsigned int> halfEdgeFace;
 
-    QVector<Vertex> vertices;
-    QVector<Face> faces;
-    QVector<HalfEdge> halfEdges;
+    // Faces, empty with implicit triangles
+    QVector<unsigned int> faceSide;
+    QVector<unsigned short> faceVal;
+    QVector<QVector3D> faceNormals;
 };
 
 #endif // MESH_H
@@ -0,0 +1,301 @@
+#include "mesh.h"
+#include "parallel.h"
+
+#include <QFile>
+
+#include <cstring>
+
+// Binary mesh file (.lsdmesh). The arrays of the Mesh are stored exactly as
+// they are kept in memory, so loading is a copy out of the mapped file and no
+// twins or boundary loops have to be recomputed. All values use the byte
+// order of the machine that wrote the file; the byte order mark lets a reader
+// on another machine reject it.
+//
+//   char[8]   magic "LSDMESH\0"
+//   quint32   version, byte order mark, flags (1 = implicit triangles)
+//   quint32   numVertices, numHalfEdges, numFaces, implicitHalfEdges
+//   followed by the arrays below, each padded to a multiple of 8 bytes:
+//   float     vertexX, vertexY, vertexZ         [numVertices]
+//   quint32   vertexOut                         [numVertices]
+//   quint16   vertexVal                         [numVertices]
+//   quint32   halfEdgeTarget, halfEdgeTwin      [numHalfEdges]
+//   quint32   halfEdgeNext, halfEdgeFace        [numHalfEdges - implicitHalfEdges]
+//   quint32   faceSide                          [numFaces], explicit meshes only
+//   quint16   faceVal                           [numFaces], explicit meshes only
+
+static const char meshFileMagic[8] = { 'L', 'S', 'D', 'M', 'E', 'S', 'H', '\0' };
+static const quint32 meshFileVersion = 1;
+static const quint32 meshFileByteOrder = 0x01020304;
+static const quint32 meshFileImplicitTriangles = 1;
+
+struct MeshFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 flags;
+    quint32 numVertices;
+    quint32 numHalfEdges;
+    quint32 numFaces;
+    quint32 implicitHalfEdges;
+    quint32 reserved;
+};
+
+static inline qint64 paddedSize(qint64 bytes) {
+    return (bytes + 7) & ~qint64(7);
+}
+
+template <typename T>
+static bool writeArray(QFile& file, const QVector<T>& array) {
+    static const char padding[8] = { 0 };
+    qint64 bytes = qint64(array.size()) * sizeof(T);
+
+    return file.write(reinterpret_cast<const char*>(array.constData()), bytes) == bytes
+        && file.write(padding, paddedSize(bytes) - bytes) == paddedSize(bytes) - bytes;
+}
+
+template <typename T>
+static const uchar* readArray(const uchar* data, QVector<T>& array, unsigned int size) {
+    array.resize(size);
+    memcpy(array.data(), data, size_t(size) * sizeof(T));
+    return data + paddedSize(qint64(size) * sizeof(T));
+}
+
+bool Mesh::writeBinary(QString fileName) {
+    QFile outFile(fileName);
+
+    if (!outFile.open(QIODevice::WriteOnly)) {
+        qWarning() << " ! Could not open" << fileName << "for writing";
+        return false;
+    }
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshFileMagic, sizeof(meshFileMagic));
+    header.version = meshFileVersion;
+    header.byteOrder = meshFileByteOrder;
+    header.flags = implicitTriangles ? meshFileImplicitTriangles : 0;
+    header.numVertices = numVertices();
+    header.numHalfEdges = numHalfEdges();
+    header.numFaces = numFaces();
+    header.implicitHalfEdges = implicitHalfEdges;
+
+    bool ok = outFile.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header)
+            && writeArray(outFile, vertexX)
+            && writeArray(outFile, vertexY)
+            && writeArray(outFile, vertexZ)
+            && writeArray(outFile, vertexOut)
+            && writeArray(outFile, vertexVal)
+            && writeArray(outFile, halfEdgeTarget)
+            && writeArray(outFile, halfEdgeTwin)
+            && writeArray(outFile, halfEdgeNext)
+            && writeArray(outFile, halfEdgeFace);
+
+    if (ok && !implicitTriangles) {
+        ok = writeArray(outFile, faceSide) && writeArray(outFile, faceVal);
+    }
+
+    outFile.close();
+
+    if (!ok) {
+        qWarning() << " ! Could not write" << fileName;
+    }
+
+    return ok;
+}
+
+bool Mesh::readBinary(QString fileName) {
+    qDebug() << ":: Loading" << fileName;
+
+    QFile inFile(fileName);
+
+    if (!inFile.open(QIODevice::ReadOnly)) {
+        qWarning() << " ! Could not open" << fileName;
+        return false;
+    }
+
+    qint64 size = inFile.size();
+    const uchar* data = size >= qint64(sizeof(MeshFileHeader)) ? inFile.map(0, size) : 0;
+
+    if (!data) {
+        qWarning() << " !" << fileName << "is not a mesh file";
+        return false;
+    }
+
+    MeshFileHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, meshFileMagic, sizeof(meshFileMagic)) != 0 || header.byteOrder != meshFileByteOrder) {
+        qWarning() << " !" << fileName << "is not a mesh file of this machine";
+        return false;
+    }
+    if (header.version != meshFileVersion) {
+        qWarning() << " !" << fileName << "has unsupported version" << header.version;
+        return false;
+    }
+
+    bool implicit = header.flags & meshFileImplicitTriangles;
+    qint64 expected = sizeof(header)
+            + 3 * paddedSize(4 * qint64(header.numVertices))
+            + paddedSize(4 * qint64(header.numVertices))
+            + paddedSize(2 * qint64(header.numVertices))
+            + 2 * paddedSize(4 * qint64(header.numHalfEdges))
+            + 2 * paddedSize(4 * (qint64(header.numHalfEdges) - header.implicitHalfEdges));
+
+    if (!implicit) {
+        expected += paddedSize(4 * qint64(header.numFaces)) + paddedSize(2 * qint64(header.numFaces));
+    }
+
+    if (header.implicitHalfEdges > header.numHalfEdges
+            || (implicit ? header.implicitHalfEdges != 3 * header.numFaces : header.implicitHalfEdges != 0)
+            || size != expected) {
+        qWarning() << " !" << fileName << "is truncated or corrupt";
+        return false;
+    }
+
+    // Read into a separate mesh first, so that a corrupt file leaves this one as it is.
+    Mesh loaded;
+    loaded.implicitTriangles = implicit;
+    loaded.implicitHalfEdges = header.implicitHalfEdges;
+
+    data += sizeof(header);
+    data = readArray(data, loaded.vertexX, header.numVertices);
+    data = readArray(data, loaded.vertexY, header.numVertices);
+    data = readArray(data, loaded.vertexZ, header.numVertices);
+    data = readArray(data, loaded.vertexOut, header.numVertices);
+    data = readArray(data, loaded.vertexVal, header.numVertices);
+    data = readArray(data, loaded.halfEdgeTarget, header.numHalfEdges);
+    data = readArray(data, loaded.halfEdgeTwin, header.numHalfEdges);
+    data = readArray(data, loaded.halfEdgeNext, header.numHalfEdges - header.implicitHalfEdges);
+    data = readArray(data, loaded.halfEdgeFace, header.numHalfEdges - header.implicitHalfEdges);
+
+    if (!implicit) {
+        data = readArray(data, loaded.faceSide, header.numFaces);
+        data = readArray(data, loaded.faceVal, header.numFaces);
+    }
+
+    if (!loaded.checkConnectivity()) {
+        qWarning() << " !" << fileName << "is truncated or corrupt";
+        return false;
+    }
+
+    implicitTriangles = implicit;
+    implicitHalfEdges = header.implicitHalfEdges;
+    attributesValid = false;
+
+    vertexX.swap(loaded.vertexX);
+    vertexY.swap(loaded.vertexY);
+    vertexZ.swap(loaded.vertexZ);
+    vertexOut.swap(loaded.vertexOut);
+    vertexVal.swap(loaded.vertexVal);
+    halfEdgeTarget.swap(loaded.halfEdgeTarget);
+    halfEdgeTwin.swap(loaded.halfEdgeTwin);
+    halfEdgeNext.swap(loaded.halfEdgeNext);
+    halfEdgeFace.swap(loaded.halfEdgeFace);
+    faceSide.swap(loaded.faceSide);
+    faceVal.swap(loaded.faceVal);
+
+    inFile.close();
+
+    qDebug() << "   # Vertices" << numVertices();
+    qDebug() << "   # HalfEdges" << numHalfEdges();
+    qDebug() << "   # Faces" << numFaces();
+
+    return true;
+}
+
+bool Mesh::checkConnectivity() const {
+    unsigned int numVerts = numVertices();
+    unsigned int numEdges = numHalfEdges();
+    unsigned int numPolys = numFaces();
+    unsigned int n = qMax(numVerts, qMax(numEdges, numPolys));
+    unsigned int numChunks = parallelChunks(n);
+
+    // Per chunk: whether it is valid, the sum of the vertex valences, the
+    // HalfEdges with a face and the sum of the face valences.
+    QVector<char> valid(numChunks, 1);
+    QVector<quint64> vertexSum(numChunks, 0), faceEdges(numChunks, 0), faceSum(numChunks, 0);
+
+    // All indices in range, NoIndex only for the out of an isolated vertex
+    // and the face of a boundary HalfEdge.
+    parallelForChunks(n, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        bool ok = true;
+
+        for (unsigned int k = begin; ok && k < end; k++) {
+            if (k < numVerts) {
+                ok = vertexOut[k] == NoIndex ? vertexVal[k] == 0 : vertexOut[k] < numEdges && vertexVal[k] > 0;
+                vertexSum[chunk] += vertexVal[k];
+            }
+            if (ok && k < numEdges) {
+                ok = halfEdgeTarget[k] < numVerts && halfEdgeTwin[k] < numEdges;
+                if (ok && k >= implicitHalfEdges) {
+                    unsigned int f = halfEdgeFace[k - implicitHalfEdges];
+                    ok = halfEdgeNext[k - implicitHalfEdges] < numEdges
+                            && (f == NoIndex || (!implicitTriangles && f < numPolys));
+                    faceEdges[chunk] += f != NoIndex;
+                }
+            }
+            if (ok && k < numPolys && !implicitTriangles) {
+                ok = faceSide[k] < numEdges && faceVal[k] > 0;
+                faceSum[chunk] += faceVal[k];
+            }
+        }
+
+        valid[chunk] = ok;
+    });
+
+    quint64 totalVertexSum = 0, totalFaceEdges = 0, totalFaceSum = 0;
+
+    for (unsigned int c = 0; c < numChunks; c++) {
+        if (!valid[c]) {
+            return false;
+        }
+        totalVertexSum += vertexSum[c];
+        totalFaceEdges += faceEdges[c];
+        totalFaceSum += faceSum[c];
+    }
+
+    // Every HalfEdge leaves one vertex and every face HalfEdge is on the cycle of its face.
+    if (totalVertexSum != numEdges || totalFaceSum != totalFaceEdges) {
+        return false;
+    }
+
+    // Twins are mutual, next continues at the target and stays in the same face,
+    // the valence many HalfEdges around a vertex all leave it, and the cycle of
+    // an explicit face closes after exactly its valence.
+    parallelForChunks(n, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        bool ok = true;
+
+        for (unsigned int k = begin; ok && k < end; k++) {
+            if (k < numEdges) {
+                ok = twin(twin(k)) == k
+                        && target(twin(next(k))) == target(k)
+                        && face(next(k)) == face(k);
+            }
+            if (ok && k < numVerts && out(k) != NoIndex) {
+                unsigned int h = out(k);
+                for (unsigned int m = 0; ok && m < valence(k); m++) {
+                    ok = target(twin(h)) == k;
+                    h = next(twin(h));
+                }
+            }
+            if (ok && k < numPolys && !implicitTriangles) {
+                unsigned int h = side(k);
+                for (unsigned int m = 0; ok && m < faceValence(k); m++) {
+                    ok = face(h) == k && (m == 0 || h != side(k));
+                    h = next(h);
+                }
+                ok = ok && h == side(k);
+            }
+        }
+
+        valid[chunk] = ok;
+    });
+
+    for (unsigned int c = 0; c < numChunks; c++) {
+        if (!valid[c]) {
+            return false;
+        }
+    }
+
+    return true;
+}
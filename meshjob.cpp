@@ -0,0 +1,85 @@
+#include "meshjob.h"
+
+MeshJob::MeshJob(const QString& fileName, quint64 budget) : fileName(fileName), level(0), limitSurface(false), weighting(NormalWeighting::Angle), keepHalfEdges(false), finished(false) {
+    cache.setBudget(budget);
+}
+
+MeshJob::MeshJob(const LevelCache& cache, int level, bool limitSurface, NormalWeighting weighting, bool keepHalfEdges)
+    : level(level), limitSurface(limitSurface), weighting(weighting), keepHalfEdges(keepHalfEdges), cache(cache), finished(false) {
+}
+
+MeshJob::~MeshJob() {
+}
+
+void MeshJob::run(const QAtomicInt& cancel, const std::function<void(int, const QString&)>& progress) {
+    if (isLoad()) {
+        progress(0, QString("Loading %1").arg(fileName));
+
+        if (fileName.endsWith(".lsdmesh")) {
+            // Prebuilt HalfEdges, nothing to parse. Stays empty if the file is invalid.
+            Mesh base;
+            base.readBinary(fileName);
+            cache.setBase(base);
+        } else {
+            OBJFile model = OBJFile(fileName);
+            if (cancel.loadAcquire() != 0) {
+                return;
+            }
+            progress(50, "Building HalfEdges");
+            cache.setBase(Mesh(&model));
+        }
+
+        finished = cancel.loadAcquire() == 0;
+        return;
+    }
+
+    // A level that is only displayed is made straight from the one below it.
+    bool direct = level > 0 && !cache.isResident(level) && !limitSurface && !keepHalfEdges;
+    int last = direct ? level - 1 : level;
+
+    // Level l takes about four times as long as level l-1.
+    quint64 total = 1, done = 0;
+    for (int l = 1; l <= level; l++) {
+        if (!cache.isResident(l)) {
+            total += quint64(1) << (2*l);
+        }
+    }
+
+    for (int l = 1; l <= last; l++) {
+        if (cache.isResident(l)) {
+            continue;
+        }
+        if (cancel.loadAcquire() != 0) {
+            return;
+        }
+        progress(int(100 * done / total), QString("Subdividing level %1").arg(l));
+        cache.level(l);
+        done += quint64(1) << (2*l);
+    }
+
+    if (cancel.loadAcquire() != 0) {
+        return;
+    }
+    progress(int(100 * done / total), QString("Preparing level %1").arg(level));
+
+    if (direct) {
+        cache.level(level - 1).subdivideLoopAttributes(vertexCoords, vertexNormals, polyIndices, edgeIndices, weighting);
+        cache.trim(level - 1);
+    } else {
+        Mesh& mesh = cache.level(level);
+        mesh.extractAttributes(limitSurface, weighting);
+        vertexCoords = mesh.getVertexCoords();
+        vertexNormals = mesh.getVertexNorms();
+        polyIndices = mesh.getPolyIndices();
+        edgeIndices = mesh.getEdgeIndices();
+        // The render attributes count towards the budget as well.
+        cache.trim(level);
+    }
+
+    if (cancel.loadAcquire() != 0) {
+        return;
+    }
+    bvh.build(vertexCoords, polyIndices);
+
+    finished = true;
+}
@@ -0,0 +1,50 @@
+#ifndef MESHJOB_H
+#define MESHJOB_H
+
+#include <QAtomicInt>
+#include <QString>
+
+#include <functional>
+
+#include "levelcache.h"
+#include "bvh.h"
+
+// Work of the viewer that runs off the GUI thread: loading a model, or making
+// the render attributes of a level (subdividing up to it as needed). The job
+// works on its own copy of the level cache, which shares the meshes with the
+// one of the viewer until either of them changes, and hands it back when it is
+// done. Only uploading the attributes is left to the GUI thread; the BVH for
+// picking is built here as well.
+class MeshJob {
+
+public:
+    // Loads fileName (.obj or .lsdmesh) as the base mesh of an empty cache.
+    MeshJob(const QString& fileName, quint64 budget);
+    // The attributes of level level of cache. With keepHalfEdges that level is
+    // built and kept in the cache even if it is only displayed.
+    MeshJob(const LevelCache& cache, int level, bool limitSurface, NormalWeighting weighting, bool keepHalfEdges = false);
+    ~MeshJob();
+
+    inline bool isLoad() const { return !fileName.isEmpty(); }
+
+    // Runs on a worker thread. Stops between two steps once cancel is set, then
+    // finished stays false. progress(percent, step) is called from that thread.
+    void run(const QAtomicInt& cancel, const std::function<void(int, const QString&)>& progress);
+
+    QString fileName;
+    int level;
+    bool limitSurface;
+    NormalWeighting weighting;
+    bool keepHalfEdges;
+    LevelCache cache;
+
+    // Results
+    bool finished;
+    QVector<QVector3D> vertexCoords;
+    QVector<QVector3D> vertexNormals;
+    QVector<unsigned int> polyIndices;
+    QVector<unsigned int> edgeIndices;
+    TriangleBVH bvh;
+};
+
+#endif // MESHJOB_H
@@ -1,65 +1,84 @@
 #include "meshrenderer.h"
+#include "parallel.h"
 
-// Computes shortest distance to a given line segment
-// If outside of line segment gives either lineStart or lineEnd.
-float distanceToLineSegment(QVector2D point, QVector2D lineStart, QVector2D lineEnd) {
-
-    float x = point.x();
-    float y = point.y();
-    float x1 = lineStart.x();
-    float y1 = lineStart.y();
-    float x2 = lineEnd.x();
-    float y2 = lineEnd.y();
-
-    float A = x - x1;
-    float B = y - y1;
-    float C = x2 - x1;
-    float D = y2 - y1;
-
-    float dot = A * C + B * D;
-    float len_sq = C * C + D * D;
-    float param = -1;
-    if (len_sq != 0) //in case of 0 length line
-        param = dot / len_sq;
-
-    float xx, yy;
-
-    // This means we are outside of point1, thus p1 is the closest on the linesegment
-    if (param < 0) {
-        xx = x1;
-        yy = y1;
-    }
-    else if (param > 1) {
-        // This means we are outside of poin2, thus p2 is closest point on the linesegment.
-        xx = x2;
-        yy = y2;
-    }
-    else {
-        xx = x1 + param * C;
-        yy = y1 + param * D;
-    }
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstddef>
+
+// Vertex of the compact format: the position quantized to 16 bits per
+// coordinate within the bounding box of the level, and the normal as signed
+// 10:10:10:2 (GL_INT_2_10_10_10_REV). 12 bytes instead of 24.
+struct PackedVertex {
+    quint16 x, y, z, pad;
+    quint32 normal;
+};
 
-    float dx = x - xx;
-    float dy = y - yy;
-    return std::sqrt(dx * dx + dy * dy);
+static inline quint16 quantize(float t) {
+    return quint16(qBound(0.0f, t, 1.0f) * 65535.0f + 0.5f);
 }
 
+static inline quint32 packSigned10(float c) {
+    return quint32(qRound(qBound(-1.0f, c, 1.0f) * 511.0f)) & 0x3FF;
+}
+
+static inline PackedVertex packVertex(const QVector3D& p, const QVector3D& n, const QVector3D& offset, const QVector3D& scale) {
+    QVector3D t = (p - offset) / scale;
+    // The normals are weighted sums, not unit vectors. Divided by hand, since
+    // normalized() gives up on very short ones.
+    float length = n.length();
+    QVector3D u = length > 0.0f ? n / length : n;
+    PackedVertex packed;
+
+    packed.x = quantize(t.x());
+    packed.y = quantize(t.y());
+    packed.z = quantize(t.z());
+    packed.pad = 0;
+    packed.normal = packSigned10(u.x()) | packSigned10(u.y()) << 10 | packSigned10(u.z()) << 20;
+    return packed;
+}
+
+// Bounding box as offset and extent; flat sides get extent 1 so that nothing
+// is divided by 0.
+static void boundingBox(const QVector<QVector3D>& coords, QVector3D& offset, QVector3D& scale) {
+    QVector3D lo(0.0, 0.0, 0.0), hi(0.0, 0.0, 0.0);
+
+    for (int k = 0; k < coords.size(); k++) {
+        if (k == 0) {
+            lo = hi = coords[k];
+        }
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(lo[i], coords[k][i]);
+            hi[i] = std::max(hi[i], coords[k][i]);
+        }
+    }
+
+    offset = lo;
+    scale = hi - lo;
+    for (int i = 0; i < 3; i++) {
+        if (scale[i] <= 0.0f) {
+            scale[i] = 1.0f;
+        }
+    }
+}
 
 MeshRenderer::MeshRenderer()
 {
-    meshIBOSize = 0;
+    shownLevel = -1;
+    showCount = 0;
+    gpuBudget = quint64(512) << 20;
+    numCageIndices = 0;
 }
 
 MeshRenderer::~MeshRenderer() {
-    gl->glDeleteVertexArrays(1, &vao);
-    gl->glDeleteVertexArrays(1, &lineSegmentVao);
+    releaseLevels(false);
 
-    gl->glDeleteBuffers(1, &tbo);
+    gl->glDeleteVertexArrays(1, &lineSegmentVao);
+    gl->glDeleteVertexArrays(1, &cageVao);
 
     gl->glDeleteBuffers(1, &lineSegmentVBO);
-    gl->glDeleteBuffers(1, &meshCoordsBO);
-    gl->glDeleteBuffers(1, &meshNormalsBO);
-    gl->glDeleteBuffers(1, &meshIndexBO);
+    gl->glDeleteBuffers(1, &cageCoordsBO);
+    gl->glDeleteBuffers(1, &cageIndexBO);
 }
 
 void MeshRenderer::init(QOpenGLFunctions_4_1_Core* f, Settings* s) {
@@ -76,10 +95,6 @@ void MeshRenderer::initShaders() {
     shaderProg.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vertshader.glsl");
     shaderProg.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fragshader.glsl");
 
-    const GLchar* feedbackVaryings[] = { "vertcoords_ndc" };
-    gl->glTransformFeedbackVaryings(shaderProg.programId(), 1, feedbackVaryings, GL_INTERLEAVED_ATTRIBS);
-
-
     shaderProg.link();
 
     uniModelViewMatrix = gl->glGetUniformLocation(shaderProg.programId(), "modelviewmatrix");
@@ -89,26 +104,7 @@ void MeshRenderer::initShaders() {
 
 void MeshRenderer::initBuffers() {
 
-    gl->glGenVertexArrays(1, &vao);
-    gl->glBindVertexArray(vao);
-
-    gl->glGenBuffers(1, &meshCoordsBO);
-    gl->glBindBuffer(GL_ARRAY_BUFFER, meshCoordsBO);
-    gl->glEnableVertexAttribArray(0);
-    gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    gl->glGenBuffers(1, &meshNormalsBO);
-    gl->glBindBuffer(GL_ARRAY_BUFFER, meshNormalsBO);
-    gl->glEnableVertexAttribArray(1);
-    gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    gl->glGenBuffers(1, &meshIndexBO);
-    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIndexBO);
-
-    gl->glGenBuffers(1, &tbo);
-    gl->glBindBuffer(GL_ARRAY_BUFFER, tbo);
-
-    gl->glBindVertexArray(0);
+    // The mesh buffers are made per level, see createLevel.
 
     // Set up vertex array for line segment buffer
     gl->glGenVertexArrays(1, &lineSegmentVao);
@@ -119,33 +115,320 @@ void MeshRenderer::initBuffers() {
     gl->glEnableVertexAttribArray(0);
     gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
+    // And one for the cage, with its own edge list.
+    gl->glGenVertexArrays(1, &cageVao);
+    gl->glBindVertexArray(cageVao);
+
+    gl->glGenBuffers(1, &cageCoordsBO);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, cageCoordsBO);
+    gl->glEnableVertexAttribArray(0);
+    gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    gl->glGenBuffers(1, &cageIndexBO);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cageIndexBO);
+
     glBindVertexArray(0);
 }
 
-void MeshRenderer::updateBuffers(Mesh& m) {
+MeshRenderer::LevelBuffers& MeshRenderer::createLevel(int level) {
+    while (levels.size() <= level) {
+        LevelBuffers none;
+        none.vao = 0;
+        levels.append(none);
+    }
+
+    LevelBuffers& buffers = levels[level];
+    if (buffers.vao != 0) {
+        return buffers;
+    }
+
+    // The attribute formats are set by updateBuffers.
+    gl->glGenVertexArrays(1, &buffers.vao);
+    gl->glBindVertexArray(buffers.vao);
+
+    gl->glGenBuffers(1, &buffers.coordsBO);
+    gl->glEnableVertexAttribArray(0);
+
+    gl->glGenBuffers(1, &buffers.normalsBO);
+    gl->glEnableVertexAttribArray(1);
+
+    gl->glGenBuffers(1, &buffers.indexBO);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBO);
+
+    gl->glBindVertexArray(0);
+
+    buffers.numVertices = 0;
+    buffers.numIndices = 0;
+    buffers.numEdgeIndices = 0;
+    buffers.compact = false;
+    buffers.vertexSize = 0;
+    buffers.indexSize = 0;
+    buffers.limitSurface = false;
+    buffers.normalWeighting = NormalWeighting::Angle;
+    buffers.outdated = false;
+    buffers.lastShown = 0;
+    buffers.bvhOutdated = false;
+
+    return buffers;
+}
+
+void MeshRenderer::releaseLevel(int level) {
+    LevelBuffers& buffers = levels[level];
+    if (buffers.vao == 0) {
+        return;
+    }
+
+    gl->glDeleteVertexArrays(1, &buffers.vao);
+    gl->glDeleteBuffers(1, &buffers.coordsBO);
+    gl->glDeleteBuffers(1, &buffers.normalsBO);
+    gl->glDeleteBuffers(1, &buffers.indexBO);
+    buffers.vao = 0;
+    buffers.coords.clear();
+    buffers.indices.clear();
+    buffers.bvh.clear();
+
+    if (level == shownLevel) {
+        shownLevel = -1;
+    }
+}
+
+void MeshRenderer::releaseLevels(bool keepShown) {
+    for (int l = 0; l < levels.size(); l++) {
+        if (keepShown && l == shownLevel) {
+            levels[l].outdated = true;
+        } else {
+            releaseLevel(l);
+        }
+    }
+}
+
+quint64 MeshRenderer::levelBytes(const LevelBuffers& buffers) const {
+    return buffers.vao == 0 ? 0 : quint64(buffers.numVertices) * buffers.vertexSize + quint64(buffers.numIndices + buffers.numEdgeIndices) * buffers.indexSize;
+}
+
+quint64 MeshRenderer::gpuBytes() const {
+    quint64 total = 0;
+    for (int l = 0; l < levels.size(); l++) {
+        total += levelBytes(levels[l]);
+    }
+    return total;
+}
+
+void MeshRenderer::setGpuBudget(quint64 bytes) {
+    gpuBudget = bytes;
+    trimLevels();
+}
+
+// Releases the levels shown least recently until the budget is met. The shown
+// level always stays.
+void MeshRenderer::trimLevels() {
+    quint64 total = gpuBytes();
+
+    while (total > gpuBudget) {
+        int oldest = -1;
+        for (int l = 0; l < levels.size(); l++) {
+            if (levels[l].vao != 0 && l != shownLevel && (oldest == -1 || levels[l].lastShown < levels[oldest].lastShown)) {
+                oldest = l;
+            }
+        }
+        if (oldest == -1) {
+            return;
+        }
+
+        qDebug() << ":: Releasing GPU buffers of level" << oldest;
+        total -= levelBytes(levels[oldest]);
+        releaseLevel(oldest);
+    }
+}
+
+bool MeshRenderer::hasLevel(int level, bool limitSurface, NormalWeighting weighting, bool compactVertices) const {
+    // The limit normals do not depend on the weighting.
+    return level < levels.size() && levels[level].vao != 0 && !levels[level].outdated
+            && levels[level].limitSurface == limitSurface && (limitSurface || levels[level].normalWeighting == weighting)
+            && levels[level].compact == compactVertices;
+}
+
+void MeshRenderer::showLevel(int level) {
+    // An outdated level is only drawn until another one replaces it.
+    if (shownLevel != -1 && shownLevel != level && levels[shownLevel].outdated) {
+        releaseLevel(shownLevel);
+    }
+
+    shownLevel = level;
+    levels[level].lastShown = ++showCount;
+}
+
+const QVector<QVector3D>& MeshRenderer::shownCoords() const {
+    static const QVector<QVector3D> none;
+    return shownLevel == -1 ? none : levels[shownLevel].coords;
+}
+
+void MeshRenderer::updateBuffers(int level, Mesh& m) {
     //gather attributes for current mesh
-    m.extractAttributes();
+    m.extractAttributes(settings->limitSurface, settings->normalWeighting);
+    updateBuffers(level, m.getVertexCoords(), m.getVertexNorms(), m.getPolyIndices(), m.getEdgeIndices());
+}
+
+void MeshRenderer::updateBuffers(int level, const QVector<QVector3D>& vertexCoords, const QVector<QVector3D>& vertexNormals,
+                                 const QVector<unsigned int>& polyIndices, const QVector<unsigned int>& edgeIndices,
+                                 const TriangleBVH& bvh) {
+    LevelBuffers& buffers = createLevel(level);
+
+    buffers.numVertices = vertexCoords.size();
+    buffers.numIndices = polyIndices.size();
+    buffers.numEdgeIndices = edgeIndices.size();
+    buffers.compact = settings->compactVertices;
+    buffers.limitSurface = settings->limitSurface;
+    buffers.normalWeighting = settings->normalWeighting;
+    buffers.outdated = false;
+
+    gl->glBindVertexArray(buffers.vao);
+
+    if (buffers.compact) {
+        QVector<PackedVertex> packed(buffers.numVertices);
+        boundingBox(vertexCoords, buffers.offset, buffers.scale);
+        parallelFor(buffers.numVertices, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                packed[k] = packVertex(vertexCoords[k], vertexNormals[k], buffers.offset, buffers.scale);
+            }
+        });
+        buffers.vertexSize = sizeof(PackedVertex);
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.coordsBO);
+        gl->glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex)*packed.size(), packed.constData(), GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), 0);
+        gl->glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.normalsBO);
+        gl->glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+    } else {
+        buffers.offset = QVector3D(0.0, 0.0, 0.0);
+        buffers.scale = QVector3D(1.0, 1.0, 1.0);
+        buffers.vertexSize = 2 * sizeof(QVector3D);
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.coordsBO);
+        gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D)*vertexCoords.size(), vertexCoords.constData(), GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.normalsBO);
+        gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D)*vertexNormals.size(), vertexNormals.constData(), GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBO);
+    if (buffers.compact && buffers.numVertices <= 0x10000) {
+        QVector<quint16> shortIndices(buffers.numIndices + buffers.numEdgeIndices);
+        for (unsigned int k = 0; k < buffers.numIndices; k++) {
+            shortIndices[k] = polyIndices[k];
+        }
+        for (unsigned int k = 0; k < buffers.numEdgeIndices; k++) {
+            shortIndices[buffers.numIndices + k] = edgeIndices[k];
+        }
+        buffers.indexType = GL_UNSIGNED_SHORT;
+        buffers.indexSize = sizeof(quint16);
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quint16)*shortIndices.size(), shortIndices.constData(), GL_STATIC_DRAW);
+    } else {
+        buffers.indexType = GL_UNSIGNED_INT;
+        buffers.indexSize = sizeof(unsigned int);
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*(polyIndices.size() + edgeIndices.size()), nullptr, GL_STATIC_DRAW);
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int)*polyIndices.size(), polyIndices.constData());
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*polyIndices.size(), sizeof(unsigned int)*edgeIndices.size(), edgeIndices.constData());
+    }
+
+    gl->glBindVertexArray(0);
+
+    // Shared with the caller, not copied.
+    buffers.coords = vertexCoords;
+    buffers.indices = polyIndices;
+    buffers.bvh = bvh;
+    buffers.bvhOutdated = false;
+    if (buffers.bvh.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        buffers.bvh.build(buffers.coords, buffers.indices);
+        qDebug() << ":: BVH over" << buffers.indices.size() / 3 << "triangles built in" << timer.elapsed() << "ms";
+    }
+
+    showLevel(level);
+    trimLevels();
+}
+
+// The base mesh is small, so it is uploaded whole every time.
+void MeshRenderer::updateCage(const Mesh& base) {
+    QVector<QVector3D> coords(base.numVertices());
+    QVector<unsigned int> edges;
+
+    for (unsigned int v = 0; v < base.numVertices(); v++) {
+        coords[v] = base.coords(v);
+    }
+    base.extractEdges(edges);
+    numCageIndices = edges.size();
+
+    gl->glBindVertexArray(cageVao);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, cageCoordsBO);
+    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D)*coords.size(), coords.constData(), GL_DYNAMIC_DRAW);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cageIndexBO);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*edges.size(), edges.constData(), GL_STATIC_DRAW);
+    gl->glBindVertexArray(0);
+}
+
+// Only the moved vertices and their neighbours are refreshed and uploaded. They
+// are sorted; runs of nearby vertices go up in one glBufferSubData call each.
+void MeshRenderer::updateVertices(Mesh& m, const QVector<unsigned int>& moved) {
+    QVector<unsigned int> updated;
+    LevelBuffers& buffers = levels[shownLevel];
+
+    // Not shared with the mesh while it writes its attributes, which would copy them.
+    buffers.coords.clear();
+
+    m.updateAttributes(moved, settings->limitSurface, settings->normalWeighting, updated);
     QVector<QVector3D>& vertexCoords = m.getVertexCoords();
     QVector<QVector3D>& vertexNormals = m.getVertexNorms();
-    QVector<unsigned int>& polyIndices = m.getPolyIndices();
 
-    gl->glBindBuffer(GL_ARRAY_BUFFER, meshCoordsBO);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D)*vertexCoords.size(), vertexCoords.data(), GL_STATIC_DRAW);
+    // Compact positions cannot leave the bounding box they were quantized in.
+    if (buffers.compact) {
+        for (int k = 0; k < updated.size(); k++) {
+            QVector3D t = (vertexCoords[updated[k]] - buffers.offset) / buffers.scale;
+            if (std::min(t.x(), std::min(t.y(), t.z())) < 0.0f || std::max(t.x(), std::max(t.y(), t.z())) > 1.0f) {
+                updateBuffers(shownLevel, vertexCoords, vertexNormals, m.getPolyIndices(), m.getEdgeIndices());
+                return;
+            }
+        }
+    }
+
+    QVector<PackedVertex> packed;
+    int first = 0;
+    while (first < updated.size()) {
+        int last = first;
+        // Uploading a small gap is cheaper than another call.
+        while (last + 1 < updated.size() && updated[last + 1] - updated[last] <= 64) {
+            last++;
+        }
+
+        unsigned int begin = updated[first];
+        unsigned int count = updated[last] - begin + 1;
 
-    gl->glBindBuffer(GL_ARRAY_BUFFER, meshNormalsBO);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D)*vertexNormals.size(), vertexNormals.data(), GL_STATIC_DRAW);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.coordsBO);
+        if (buffers.compact) {
+            packed.resize(count);
+            for (unsigned int k = 0; k < count; k++) {
+                packed[k] = packVertex(vertexCoords[begin + k], vertexNormals[begin + k], buffers.offset, buffers.scale);
+            }
+            gl->glBufferSubData(GL_ARRAY_BUFFER, sizeof(PackedVertex)*begin, sizeof(PackedVertex)*count, packed.constData());
+        } else {
+            gl->glBufferSubData(GL_ARRAY_BUFFER, sizeof(QVector3D)*begin, sizeof(QVector3D)*count, vertexCoords.constData() + begin);
 
-    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIndexBO);
-    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*polyIndices.size(), polyIndices.data(), GL_STATIC_DRAW);
+            gl->glBindBuffer(GL_ARRAY_BUFFER, buffers.normalsBO);
+            gl->glBufferSubData(GL_ARRAY_BUFFER, sizeof(QVector3D)*begin, sizeof(QVector3D)*count, vertexNormals.constData() + begin);
+        }
 
-    // Bind transform feedback buffer.
-    gl->glBindBuffer(GL_ARRAY_BUFFER, tbo);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D) * vertexCoords.size(), nullptr, GL_STATIC_READ);
-    transformFeedbackBufferSize = sizeof(QVector3D) * vertexCoords.size();
+        first = last + 1;
+    }
 
-    meshIBOSize = polyIndices.size();
-    lastIndexBuffer = polyIndices;
-    lastVertexBuffer = vertexCoords;
+    // The triangles stay the same, so the BVH only needs new bounds.
+    buffers.coords = vertexCoords;
+    buffers.bvhOutdated = true;
+    buffers.outdated = false;
 }
 
 void MeshRenderer::updateUniforms() {
@@ -168,56 +451,33 @@ void MeshRenderer::draw() {
     // Reset selection mode and update all other uniforms.
     shaderProg.setUniformValue("selectLine", false);
     shaderProg.setUniformValue("selectionMode", false);
+    shaderProg.setUniformValue("drawCage", false);
     shaderProg.setUniformValue("drawReflectionLines", settings->drawReflectionLines);
     shaderProg.setUniformValue("sineScale", (float)settings->reflectionLinesDensity);
     shaderProg.setUniformValue("testNormal", (float)settings->reflectionLineX, (float)settings->reflectionLineY, (float)settings->reflectionLineZ);
 
 
-    gl->glBindVertexArray(vao);
+    if (shownLevel == -1) {
+        shaderProg.release();
+        return;
+    }
 
-    // Okay so this is kinda cheesy/hacky, but I use the transform feedback buffer to grab all coordinates of the vertices in NDC space.
-    // This is done by binding the vertex buffer as GL_POINTS so I get vertices in my feedback buffer.
-    // First I disabled rasterization output for rendering my vertices, since we don't want output on the screen.
-    // I modified the shader such that it outputs NDC coordinates for every vertex.
-    // These coordinates are ignored under normal rendering, but they are outputed to the transform feedback buffer
-    // on a per point/vertex basis. So therefore, the gpu first calculates NDC coordinates for all my vertices.
-    // After which I simply copy it back to host memory (RAM), and compute the closest point with the NDC
-    // picking point I got from the mouse on the cpu.
-    // After which I enable rasterization again and redraw everything as I normally would.
-    // Yes, yes... this approach is really stupid and horribly inneficient... but it's fun to implement and it works!
-    // It avoids me from doing complicated maths in order to revert the projections. =)
-    // After determining the closest vertex, I simply redraw my vertices as points and make a big nice dot at the vertex position.
+    const LevelBuffers& buffers = levels[shownLevel];
+    gl->glBindVertexArray(buffers.vao);
+    shaderProg.setUniformValue("positionoffset", buffers.offset);
+    shaderProg.setUniformValue("positionscale", buffers.scale);
 
+    // Picking happens on the CPU, see pick.
     if (pointUpdated) {
-        // Bind transform feedback buffer.
-        gl->glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo);
-        // Discard geometry at rasterization, since we only want transform feedback output.
-        gl->glEnable(GL_RASTERIZER_DISCARD);
-        // Enable transform feedback
-        gl->glBeginTransformFeedback(GL_POINTS);
-        // Draw into transform feedback
-        gl->glDrawArrays(GL_POINTS, 0, transformFeedbackBufferSize / sizeof(QVector3D));
-        // Disable transform feedback again.
-        gl->glEndTransformFeedback();
-
-        // Wait for completion of drawcommands.
-        gl->glFlush();
-
-        // Write back transform feedback buffer to CPU memory.
-        transformFeedbackBuffer.resize(transformFeedbackBufferSize / sizeof(QVector3D));
-        gl->glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, transformFeedbackBufferSize, transformFeedbackBuffer.data());
-
-        // Compute closest vertex.
-        selectedVertex = computeClosestVertex();
-        // Cpmpute closest line segment.
-        computeClosestLineSegment();
-
-        //Now we redraw everything again!
-        // But with enabled rasterization ofcourse
-        gl->glDisable(GL_RASTERIZER_DISCARD);
+        pick();
     }
 
-    gl->glDrawElements(GL_TRIANGLES, meshIBOSize, GL_UNSIGNED_INT, 0);
+    // Wireframe draws every edge once, instead of the sides of all triangles.
+    if (settings->wireframeMode) {
+        gl->glDrawElements(GL_LINES, buffers.numEdgeIndices, buffers.indexType, (void*)(quintptr(buffers.numIndices) * buffers.indexSize));
+    } else {
+        gl->glDrawElements(GL_TRIANGLES, buffers.numIndices, buffers.indexType, 0);
+    }
 
     // Set point update to false.
     pointUpdated = false;
@@ -237,6 +497,9 @@ void MeshRenderer::draw() {
 
         // Unfortunately, since we have a GL_TRIANGLES indexbuffer, it means we need a separate vao+buffer to draw linesegments in.
         gl->glBindVertexArray(lineSegmentVao);
+        // Its coordinates are plain floats.
+        shaderProg.setUniformValue("positionoffset", QVector3D(0.0, 0.0, 0.0));
+        shaderProg.setUniformValue("positionscale", QVector3D(1.0, 1.0, 1.0));
         gl->glBindBuffer(GL_ARRAY_BUFFER, lineSegmentVBO);
         // Update line segment buffer
         gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D) * 2, (void*)(&lineSegmentBuffer[0]), GL_STATIC_DRAW);
@@ -252,6 +515,37 @@ void MeshRenderer::draw() {
         shaderProg.setUniformValue("selectLine", false);
     }
 
+    if (selectedFace != -1 && settings->selectionMode == 3) {
+        shaderProg.setUniformValue("selectionMode", true);
+
+        gl->glBindVertexArray(lineSegmentVao);
+        shaderProg.setUniformValue("positionoffset", QVector3D(0.0, 0.0, 0.0));
+        shaderProg.setUniformValue("positionscale", QVector3D(1.0, 1.0, 1.0));
+        gl->glBindBuffer(GL_ARRAY_BUFFER, lineSegmentVBO);
+        gl->glBufferData(GL_ARRAY_BUFFER, sizeof(QVector3D) * 3, (void*)(&faceBuffer[0]), GL_STATIC_DRAW);
+
+        // In front of the face itself, whose (compact) coordinates may differ slightly.
+        gl->glEnable(GL_POLYGON_OFFSET_FILL);
+        gl->glPolygonOffset(-1.0, -1.0);
+        gl->glDrawArrays(GL_TRIANGLES, 0, 3);
+        gl->glDisable(GL_POLYGON_OFFSET_FILL);
+    }
+
+    // The cage of the base mesh goes over everything.
+    if (settings->showCage && numCageIndices > 0) {
+        shaderProg.setUniformValue("selectionMode", false);
+        shaderProg.setUniformValue("drawCage", true);
+
+        gl->glBindVertexArray(cageVao);
+        shaderProg.setUniformValue("positionoffset", QVector3D(0.0, 0.0, 0.0));
+        shaderProg.setUniformValue("positionscale", QVector3D(1.0, 1.0, 1.0));
+        gl->glDisable(GL_DEPTH_TEST);
+        gl->glDrawElements(GL_LINES, numCageIndices, GL_UNSIGNED_INT, 0);
+        gl->glEnable(GL_DEPTH_TEST);
+
+        shaderProg.setUniformValue("drawCage", false);
+    }
+
     //Reset selection mode
     shaderProg.setUniformValue("selectionMode", false);
 
@@ -261,95 +555,52 @@ void MeshRenderer::draw() {
 
 }
 
-
-bool isClipped(QVector3D point) {
-
-    return point.x() < -1 || point.x() > 1 ||
-            point.y() < -1 || point.y() > 1 ||
-            point.z() < -1 || point.z() > 1;
+void MeshRenderer::clearSelection() {
+    selectedVertex = -1;
+    selectedFace = -1;
 }
 
+// The ray runs from the near to the far plane through lastPickedPoint, in model
+// coordinates. Only the first triangle it hits counts, so hidden parts of the
+// mesh cannot be selected. Of that triangle, the corner closest to the hit is
+// the selected vertex and the side closest to it the selected edge.
+void MeshRenderer::pick() {
+    bool invertible;
+    QMatrix4x4 fromClip = (settings->projectionMatrix * settings->modelViewMatrix).inverted(&invertible);
+    RayHit hit;
+
+    clearSelection();
 
-// Computes closest line segment.
-// It is implemented as the smalled NDC space distance to the midpoint of a edge.
-void MeshRenderer::computeClosestLineSegment() {
-    if (!pointUpdated) {
+    if (!invertible || shownLevel == -1 || levels[shownLevel].indices.isEmpty()) {
         return;
     }
-    // Initial distance is max float
-    float distanceFromLine = 3.402823E+38;
-    bool isSet = false;
-
-    QVector3D firstVertex;
-    QVector3D secondVertex;
-
-    // Iterate over index buffer in sets of 3, since we use GL_TRIANGLES layout for the index buffer.
-    for(int i = 0; i < lastIndexBuffer.size(); i += 3) {
-        // Grab the vertices of our triangle in NDC space
-        auto v1 = transformFeedbackBuffer[lastIndexBuffer[i]];
-        auto v2 = transformFeedbackBuffer[lastIndexBuffer[i + 1]];
-        auto v3 = transformFeedbackBuffer[lastIndexBuffer[i + 2]];
-
-        // Compute distances to line segments.
-        float d1 = distanceToLineSegment(lastPickedPoint, QVector2D(v1), QVector2D(v2));
-        float d2 = distanceToLineSegment(lastPickedPoint, QVector2D(v2), QVector2D(v3));
-        float d3 = distanceToLineSegment(lastPickedPoint, QVector2D(v3), QVector2D(v1));
-
-        // Set shortest distance and store it
-        // We also need to check for clipping, since we don't want invisible vertices to affect our selection.
-        // I also chose to only allow fully visible edges. (i.e. both vertices must be within the visible space).
-        if (i == 0 || ((d1 < distanceFromLine) && !(isClipped(v1) || isClipped(v2)))) {
-            distanceFromLine = d1;
-            firstVertex = lastVertexBuffer[lastIndexBuffer[i]];
-            secondVertex = lastVertexBuffer[lastIndexBuffer[i + 1]];
-
-            if ((d1 < distanceFromLine) && !(isClipped(v1) || isClipped(v2)))
-                isSet = true;
-        }
-        if (d2 < distanceFromLine && !(isClipped(v2) || isClipped(v3))) {
-            distanceFromLine = d2;
-            firstVertex = lastVertexBuffer[lastIndexBuffer[i + 1]];
-            secondVertex = lastVertexBuffer[lastIndexBuffer[i + 2]];
-            isSet = true;
-        }
-        if (d3 < distanceFromLine && !(isClipped(v3) || isClipped(v1))) {
-            distanceFromLine = d3;
-            firstVertex = lastVertexBuffer[lastIndexBuffer[i + 2]];
-            secondVertex = lastVertexBuffer[lastIndexBuffer[i]];
-            isSet = true;
-        }
-    }
 
-    // These two points together form the closest line segment.
-    if (isSet) {
-        lineSegmentBuffer[0] = firstVertex;
-        lineSegmentBuffer[1] = secondVertex;
-    } else {
-        qDebug() << "Weirdness occured!";
+    LevelBuffers& buffers = levels[shownLevel];
+    const QVector<QVector3D>& coords = buffers.coords;
+    const QVector<unsigned int>& indices = buffers.indices;
+
+    if (buffers.bvhOutdated) {
+        buffers.bvh.refit(coords, indices);
+        buffers.bvhOutdated = false;
     }
-}
 
-// Computes the vertex index which is closest to the lastPickedPointlastPickedPoint.
-int MeshRenderer::computeClosestVertex() {
-    if (!pointUpdated) {
-        return -1;
+    QVector3D nearPoint = (fromClip * QVector4D(lastPickedPoint, -1.0, 1.0)).toVector3DAffine();
+    QVector3D farPoint = (fromClip * QVector4D(lastPickedPoint, 1.0, 1.0)).toVector3DAffine();
+
+    if (!buffers.bvh.intersect(coords, indices, nearPoint, farPoint - nearPoint, hit) || hit.t > 1.0f) {
+        return;
     }
 
-    // Initial distance is max float
-    float distanceFromNDCSelectedPoint = 3.402823E+38;
-    int closestIndex = 0;
-    // Effectively computes closest vertex in NDC space to the picket point (also in NDC space).
-    for(int i = 0; i < transformFeedbackBuffer.size(); ++i) {
-        if (i == 0) {
-            distanceFromNDCSelectedPoint = abs(transformFeedbackBuffer[i].distanceToPoint(lastPickedPoint));
-            closestIndex = i;
-        } else {
-            float distance = abs(transformFeedbackBuffer[i].distanceToPoint(lastPickedPoint));
-            if (distance < distanceFromNDCSelectedPoint) {
-                distanceFromNDCSelectedPoint = distance;
-                closestIndex = i;
-            }
-        }
+    const unsigned int* corners = indices.constData() + 3 * hit.triangle;
+    float weights[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+    int closest = std::max_element(weights, weights + 3) - weights;
+    int farthest = std::min_element(weights, weights + 3) - weights;
+
+    selectedVertex = corners[closest];
+    selectedFace = hit.triangle;
+    lineSegmentBuffer[0] = coords[corners[(farthest + 1) % 3]];
+    lineSegmentBuffer[1] = coords[corners[(farthest + 2) % 3]];
+    for (int i = 0; i < 3; i++) {
+        faceBuffer[i] = coords[corners[i]];
     }
-    return closestIndex;
 }
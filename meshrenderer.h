@@ -5,6 +5,7 @@
 
 #include "renderer.h"
 #include "mesh.h"
+#include "bvh.h"
 #include <memory>
 
 using std::unique_ptr;
@@ -22,27 +23,85 @@ public:
 
     void updateUniforms();
 
-    void updateBuffers(Mesh& m);
-    void draw();
+    // GPU buffers are kept per subdivision level, up to a budget; the levels
+    // shown least recently go first. Showing a level that is still there only
+    // binds its vertex array.
+    bool hasLevel(int level, bool limitSurface, NormalWeighting weighting, bool compactVertices) const;
+    void showLevel(int level);
+    // Uploads the attributes of level level and shows it.
+    void updateBuffers(int level, Mesh& m);
+    // Attributes that were made without a Mesh, see Mesh::subdivideLoopAttributes.
+    // bvh is over vertexCoords and polyIndices, it is built here if empty.
+    void updateBuffers(int level, const QVector<QVector3D>& vertexCoords, const QVector<QVector3D>& vertexNormals,
+                       const QVector<unsigned int>& polyIndices, const QVector<unsigned int>& edgeIndices,
+                       const TriangleBVH& bvh = TriangleBVH());
+    // Partial update of the shown level after moving vertices of m, see
+    // Mesh::updateAttributes. The shown level counts as up to date again after it.
+    void updateVertices(Mesh& m, const QVector<unsigned int>& moved);
+    // Drops the buffers of all levels. With keepShown, the shown level is still
+    // drawn until another one replaces it, but hasLevel no longer reports it.
+    void releaseLevels(bool keepShown);
+    void setGpuBudget(quint64 bytes);
+    quint64 gpuBytes() const;
+    // Edges of the base mesh, drawn over the shown level with showCage.
+    void updateCage(const Mesh& base);
 
-    int computeClosestVertex();
-    void computeClosestLineSegment();
+    void draw();
 
-    QVector<unsigned int> lastIndexBuffer;
-    QVector<QVector3D> lastVertexBuffer;
+    // Casts the ray through lastPickedPoint and selects the closest vertex,
+    // edge and face of the triangle it hits first.
+    void pick();
+    void clearSelection();
+    // Positions of the shown level, empty if there is none.
+    const QVector<QVector3D>& shownCoords() const;
 
     QVector3D lineSegmentBuffer[2];
-    QVector<QVector3D> transformFeedbackBuffer;
+    QVector3D faceBuffer[3];
     QVector2D lastPickedPoint;
     bool pointUpdated = false;
     int selectedVertex = -1;
+    int selectedFace = -1;
 private:
+    // vao is 0 for levels without buffers. In the compact vertex format,
+    // coordsBO holds the interleaved vertices (see PackedVertex in
+    // meshrenderer.cpp) and normalsBO is empty. Positions are offset + scale
+    // times their normalized coordinates; offset 0 and scale 1 for floats.
+    // indexBO holds the triangles, then the edges (for wireframe). For picking,
+    // coords and indices keep the uploaded positions and triangles on the CPU
+    // (shared with the arrays they came from), with a BVH over them that is
+    // refit on the next pick after vertices moved.
+    struct LevelBuffers {
+        GLuint vao;
+        GLuint coordsBO, normalsBO, indexBO;
+        unsigned int numVertices, numIndices, numEdgeIndices;
+        bool compact;
+        GLenum indexType;
+        unsigned int vertexSize, indexSize;
+        QVector3D offset, scale;
+        bool limitSurface;
+        NormalWeighting normalWeighting;
+        bool outdated;
+        unsigned int lastShown;
+        QVector<QVector3D> coords;
+        QVector<unsigned int> indices;
+        TriangleBVH bvh;
+        bool bvhOutdated;
+    };
+
+    LevelBuffers& createLevel(int level);
+    void releaseLevel(int level);
+    void trimLevels();
+    quint64 levelBytes(const LevelBuffers& buffers) const;
+
+    QVector<LevelBuffers> levels;
+    int shownLevel;
+    unsigned int showCount;
+    quint64 gpuBudget;
 
-    int transformFeedbackBufferSize;
-    GLuint vao, lineSegmentVao;
-    GLuint tbo; //Transform feedback buffer
-    GLuint meshCoordsBO, meshNormalsBO, meshIndexBO, lineSegmentVBO;
-    unsigned int meshIBOSize;
+    GLuint lineSegmentVao;
+    GLuint lineSegmentVBO;
+    GLuint cageVao, cageCoordsBO, cageIndexBO;
+    unsigned int numCageIndices;
     QOpenGLShaderProgram shaderProg;
 
     // Uniforms
@@ -0,0 +1,348 @@
+#include "meshstream.h"
+
+#include <QBitArray>
+#include <QFile>
+#include <QTextStream>
+
+#include <memory>
+
+// The children of a face are identified by the implicit triangle layout of
+// refineTriangles: at every level, child i < 3 of a face with corners T is the
+// corner face (T_i, M_i+1, M_i) and child 3 the inner face (M_1, M_2, M_0),
+// where M_i is the midpoint of T_i-1 and T_i. Corners are tracked as integer
+// barycentric weights on the three corners of the base face, summing to 2^levels.
+
+namespace {
+
+struct StreamLayout {
+    const Mesh* base;
+    quint64 n;
+    quint64 numVertices;
+    quint64 numEdges;
+    unsigned int patchSize;
+    // Edge of every base HalfEdge, numbered by the HalfEdge with the lowest index.
+    QVector<unsigned int> edgeId;
+    // Lowest face around every base vertex resp. edge, its patch writes the vertex.
+    QVector<unsigned int> vertexFace;
+    QVector<unsigned int> edgeFace;
+
+    inline quint64 verticesPerEdge() const { return n - 1; }
+    inline quint64 verticesPerFace() const { return (n - 1) * (n - 2) / 2; }
+    inline quint64 numOutput() const {
+        return numVertices + numEdges * verticesPerEdge() + quint64(base->numFaces()) * verticesPerFace();
+    }
+
+    // ID of the vertex at weights w in base face f, with the sides of f in sides.
+    // Sets owner to the face whose patch writes it.
+    quint64 vertexId(unsigned int f, const unsigned int* sides, const quint64* w, unsigned int& owner) const {
+        for (unsigned int i = 0; i < 3; i++) {
+            if (w[i] == n) {
+                unsigned int v = base->target(sides[i]);
+                owner = vertexFace[v];
+                return v;
+            }
+        }
+
+        for (unsigned int i = 0; i < 3; i++) {
+            if (w[i] == 0) {
+                // Side (i+2)%3 runs from corner (i+1)%3 to corner (i+2)%3.
+                unsigned int h = sides[(i + 2) % 3];
+                unsigned int tail = base->target(base->twin(h));
+                quint64 fromTail = w[(i + 2) % 3];
+                // Count from the lower vertex of the edge, so both faces agree.
+                quint64 position = tail < base->target(h) ? fromTail : n - fromTail;
+
+                owner = edgeFace[edgeId[h]];
+                return numVertices + edgeId[h] * verticesPerEdge() + position - 1;
+            }
+        }
+
+        // Inside the face, rows of constant w[1].
+        quint64 row = w[1] - 1;
+        owner = f;
+        return numVertices + numEdges * verticesPerEdge() + f * verticesPerFace()
+                + row * (n - 1) - row * (row + 1) / 2 + w[2] - 1;
+    }
+};
+
+}
+
+static inline void sidesOf(const Mesh& mesh, unsigned int f, unsigned int* sides) {
+    sides[0] = mesh.side(f);
+    sides[1] = mesh.next(sides[0]);
+    sides[2] = mesh.next(sides[1]);
+}
+
+bool subdivideLoopToOBJ(const Mesh& base, unsigned int levels, QString fileName, quint64 patchFaces) {
+    qDebug() << ":: Streaming Loop subdivision to" << fileName;
+
+    unsigned int numFaces = base.numFaces();
+    unsigned int numVerts = base.numVertices();
+    unsigned int numHalfEdges = base.numHalfEdges();
+    unsigned int sides[3];
+
+    for (unsigned int f = 0; f < numFaces; f++) {
+        if (base.faceValence(f) != 3) {
+            qWarning() << " ! Streaming subdivision needs a triangle mesh, face" << f << "has valence" << base.faceValence(f);
+            return false;
+        }
+    }
+
+    if (levels > 15) {
+        qWarning() << " ! Too many levels for streaming subdivision:" << levels;
+        return false;
+    }
+
+    StreamLayout layout;
+    layout.base = &base;
+    layout.n = 1ull << levels;
+    layout.numVertices = numVerts;
+    layout.edgeId.resize(numHalfEdges);
+    layout.vertexFace.fill(Mesh::NoIndex, numVerts);
+
+    unsigned int numEdges = 0;
+    for (unsigned int h = 0; h < numHalfEdges; h++) {
+        if (h < base.twin(h)) {
+            layout.edgeId[h] = numEdges;
+            layout.edgeId[base.twin(h)] = numEdges;
+            numEdges++;
+        }
+    }
+    layout.numEdges = numEdges;
+    layout.edgeFace.fill(Mesh::NoIndex, numEdges);
+
+    for (unsigned int f = 0; f < numFaces; f++) {
+        sidesOf(base, f, sides);
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int v = base.target(sides[i]);
+            unsigned int e = layout.edgeId[sides[i]];
+            layout.vertexFace[v] = qMin(layout.vertexFace[v], f);
+            layout.edgeFace[e] = qMin(layout.edgeFace[e], f);
+        }
+    }
+
+    // Faces around every vertex. Unlike walking the ring this also finds all faces
+    // around non-manifold vertices.
+    QVector<unsigned int> vertexFaceStart(numVerts + 1, 0);
+    QVector<unsigned int> vertexFaces(3 * numFaces);
+
+    for (unsigned int f = 0; f < numFaces; f++) {
+        sidesOf(base, f, sides);
+        for (unsigned int i = 0; i < 3; i++) {
+            vertexFaceStart[base.target(sides[i]) + 1]++;
+        }
+    }
+    for (unsigned int v = 0; v < numVerts; v++) {
+        vertexFaceStart[v + 1] += vertexFaceStart[v];
+    }
+    QVector<unsigned int> vertexFaceEnd = vertexFaceStart;
+    for (unsigned int f = 0; f < numFaces; f++) {
+        sidesOf(base, f, sides);
+        for (unsigned int i = 0; i < 3; i++) {
+            vertexFaces[vertexFaceEnd[base.target(sides[i])]++] = f;
+        }
+    }
+
+    // Every face has 4^levels children.
+    if (patchFaces == 0) {
+        patchFaces = 1 << 22;
+    }
+    layout.patchSize = qMax(quint64(1), qMin(quint64(numFaces), patchFaces >> (2 * levels)));
+
+    unsigned int numPatches = (numFaces + layout.patchSize - 1) / layout.patchSize;
+    quint64 numOutput = layout.numOutput();
+
+    qDebug() << " *" << numPatches << "patches of" << layout.patchSize << "faces," << numOutput << "vertices";
+
+    // Positions are written at their ID into a mapped scratch file, faces go to a
+    // second one. Both are joined into the OBJ file at the end.
+    QFile positionFile(fileName + ".positions");
+    QFile faceFile(fileName + ".faces");
+
+    if (!positionFile.open(QIODevice::ReadWrite | QIODevice::Truncate)
+            || !positionFile.resize(qint64(numOutput) * 3 * sizeof(float))
+            || !faceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << " ! Could not create scratch files next to" << fileName;
+        positionFile.remove();
+        faceFile.remove();
+        return false;
+    }
+
+    uchar* positionData = positionFile.map(0, positionFile.size());
+    if (!positionData) {
+        qWarning() << " ! Could not map" << positionFile.fileName();
+        positionFile.remove();
+        faceFile.remove();
+        return false;
+    }
+    float* positions = reinterpret_cast<float*>(positionData);
+
+    // Isolated vertices are not part of any patch.
+    for (unsigned int v = 0; v < numVerts; v++) {
+        if (base.out(v) == Mesh::NoIndex) {
+            positions[3*v] = base.coords(v).x();
+            positions[3*v + 1] = base.coords(v).y();
+            positions[3*v + 2] = base.coords(v).z();
+        }
+    }
+
+    QTextStream faceStream(&faceFile);
+
+    // Base vertex and face indices of the current patch, stamped with its number.
+    QVector<unsigned int> localVertex(numVerts);
+    QVector<unsigned int> vertexStamp(numVerts, Mesh::NoIndex);
+    QVector<unsigned int> faceStamp(numFaces, Mesh::NoIndex);
+    QVector<unsigned int> patchFace;
+    QBitArray written;
+
+    for (unsigned int p = 0; p < numPatches; p++) {
+        unsigned int first = p * layout.patchSize;
+        unsigned int last = qMin(first + layout.patchSize, numFaces);
+
+        // The patch, followed by its halo: all faces around the vertices of the patch.
+        patchFace.clear();
+        for (unsigned int f = first; f < last; f++) {
+            patchFace.append(f);
+            faceStamp[f] = p;
+        }
+
+        for (unsigned int f = first; f < last; f++) {
+            sidesOf(base, f, sides);
+            for (unsigned int i = 0; i < 3; i++) {
+                unsigned int v = base.target(sides[i]);
+                for (unsigned int k = vertexFaceStart[v]; k < vertexFaceStart[v + 1]; k++) {
+                    unsigned int g = vertexFaces[k];
+                    if (faceStamp[g] != p) {
+                        faceStamp[g] = p;
+                        patchFace.append(g);
+                    }
+                }
+            }
+        }
+
+        OBJFile patchOBJ;
+
+        for (int k = 0; k < patchFace.size(); k++) {
+            sidesOf(base, patchFace[k], sides);
+            for (unsigned int i = 0; i < 3; i++) {
+                unsigned int v = base.target(sides[i]);
+                if (vertexStamp[v] != p) {
+                    vertexStamp[v] = p;
+                    localVertex[v] = patchOBJ.vertexCoords.size();
+                    patchOBJ.vertexCoords.append(base.coords(v));
+                }
+                patchOBJ.faceCoordInd.append(localVertex[v]);
+            }
+            patchOBJ.faceValences.append(3);
+        }
+
+        std::unique_ptr<Mesh> mesh(new Mesh(&patchOBJ, true));
+
+        for (unsigned int l = 0; l < levels; l++) {
+            std::unique_ptr<Mesh> refined(new Mesh());
+            mesh->subdivideLoop(*refined);
+            mesh = std::move(refined);
+        }
+
+        written.fill(false, mesh->numVertices());
+
+        // The children of the patch faces come first.
+        quint64 numChildren = quint64(last - first) << (2 * levels);
+        quint64 w[3][3];
+        quint64 corner[3][3];
+        quint64 mid[3][3];
+        quint64 id[3];
+        unsigned int owner;
+
+        for (quint64 g = 0; g < numChildren; g++) {
+            unsigned int f = patchFace[g >> (2 * levels)];
+
+            for (unsigned int i = 0; i < 3; i++) {
+                for (unsigned int j = 0; j < 3; j++) {
+                    w[i][j] = i == j ? layout.n : 0;
+                }
+            }
+
+            for (unsigned int l = levels; l > 0; l--) {
+                unsigned int child = (g >> (2 * (l - 1))) & 3;
+
+                for (unsigned int i = 0; i < 3; i++) {
+                    for (unsigned int j = 0; j < 3; j++) {
+                        corner[i][j] = w[i][j];
+                        mid[i][j] = (w[(i + 2) % 3][j] + w[i][j]) / 2;
+                    }
+                }
+
+                for (unsigned int j = 0; j < 3; j++) {
+                    if (child < 3) {
+                        w[0][j] = corner[child][j];
+                        w[1][j] = mid[(child + 1) % 3][j];
+                        w[2][j] = mid[child][j];
+                    } else {
+                        w[0][j] = mid[1][j];
+                        w[1][j] = mid[2][j];
+                        w[2][j] = mid[0][j];
+                    }
+                }
+            }
+
+            sidesOf(base, f, sides);
+
+            for (unsigned int i = 0; i < 3; i++) {
+                unsigned int v = mesh->target(3*g + i);
+                id[i] = layout.vertexId(f, sides, w[i], owner);
+
+                if (!written.testBit(v) && owner / layout.patchSize == p) {
+                    written.setBit(v);
+                    QVector3D point = mesh->coords(v);
+                    positions[3*id[i]] = point.x();
+                    positions[3*id[i] + 1] = point.y();
+                    positions[3*id[i] + 2] = point.z();
+                }
+            }
+
+            // Note +1, OBJ starts indexing from 1.
+            faceStream << "f " << id[0] + 1 << " " << id[1] + 1 << " " << id[2] + 1 << "\n";
+        }
+
+        qDebug() << " * Patch" << p + 1 << "of" << numPatches << "(" << patchFace.size() - (last - first) << "halo faces)";
+    }
+
+    faceStream.flush();
+    bool ok = faceStream.status() == QTextStream::Ok;
+    faceFile.close();
+
+    // Join the scratch files into the OBJ file.
+    QFile outFile(fileName);
+    ok = ok && outFile.open(QIODevice::WriteOnly | QIODevice::Text) && faceFile.open(QIODevice::ReadOnly);
+
+    if (ok) {
+        QTextStream fileContents(&outFile);
+        // 9 significant digits read back as the same float. With the default
+        // of 6, neighbouring vertices of deep levels get the same coordinates.
+        fileContents.setRealNumberPrecision(9);
+
+        for (quint64 k = 0; k < numOutput; k++) {
+            fileContents << "v " << positions[3*k] << " " << positions[3*k + 1] << " " << positions[3*k + 2] << "\n";
+        }
+        fileContents.flush();
+        ok = fileContents.status() == QTextStream::Ok;
+
+        QByteArray block;
+        while (ok && !(block = faceFile.read(1 << 20)).isEmpty()) {
+            ok = outFile.write(block) == block.size();
+        }
+
+        outFile.close();
+    }
+
+    if (!ok) {
+        qWarning() << " ! Could not write" << fileName;
+    }
+
+    positionFile.unmap(positionData);
+    positionFile.remove();
+    faceFile.remove();
+
+    return ok;
+}
@@ -0,0 +1,21 @@
+#ifndef MESHSTREAM_H
+#define MESHSTREAM_H
+
+#include "mesh.h"
+
+// Out-of-core Loop subdivision. The faces of base are split into patches of
+// consecutive faces; every patch is subdivided together with the faces around
+// it (its one-ring halo) and only the children of the patch itself are kept.
+// Only one patch is in memory at a time. The final level is written to
+// fileName as OBJ.
+//
+// Vertices get an ID from their position on the base mesh: base vertices keep
+// their index, followed by the vertices inside the base edges and then the
+// vertices inside the base faces. Vertices shared by patches are written once
+// and faces refer to them by ID, so the file does not depend on the patch size.
+//
+// patchFaces bounds the number of final level faces per patch (without halo),
+// 0 picks a default. base must be a triangle mesh.
+bool subdivideLoopToOBJ(const Mesh& base, unsigned int levels, QString fileName, quint64 patchFaces = 0);
+
+#endif // MESHSTREAM_H
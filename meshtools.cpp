@@ -1,234 +1,752 @@
 #include "meshtools.h"
+#include "parallel.h"
+#include "stencilkernels.h"
 
-void Mesh::subdivideLoop(Mesh& mesh) {
-    QVector<Vertex>& newVertices = mesh.getVertices();
-    QVector<HalfEdge>& newHalfEdges = mesh.getHalfEdges();
-    QVector<Face>& newFaces = mesh.getFaces();
+#include <QVarLengthArray>
 
+#include <algorithm>
+#include <math.h>
+
+// Warren's weights for interior vertices, as vertexPoint computes them: beta
+// on every ring vertex and 1 - n*beta on the vertex itself.
+static constexpr float warrenBeta(unsigned int n) {
+    return n == 3 ? 3.0f/16.0f : float(3.0/(8*n));
+}
+static constexpr float warrenCentre(unsigned int n) {
+    return float(1.0 - n*double(warrenBeta(n)));
+}
+
+// Interior vertices up to this valence have a kernel of their own, the others
+// go through vertexPoint.
+static const unsigned int MaxSpecializedValence = 16;
+
+static constexpr float WarrenBeta[MaxSpecializedValence + 1] = {
+    0.0f, 0.0f, 0.0f, warrenBeta(3), warrenBeta(4), warrenBeta(5), warrenBeta(6), warrenBeta(7), warrenBeta(8),
+    warrenBeta(9), warrenBeta(10), warrenBeta(11), warrenBeta(12), warrenBeta(13), warrenBeta(14), warrenBeta(15), warrenBeta(16)
+};
+static constexpr float WarrenCentre[MaxSpecializedValence + 1] = {
+    0.0f, 0.0f, 0.0f, warrenCentre(3), warrenCentre(4), warrenCentre(5), warrenCentre(6), warrenCentre(7), warrenCentre(8),
+    warrenCentre(9), warrenCentre(10), warrenCentre(11), warrenCentre(12), warrenCentre(13), warrenCentre(14), warrenCentre(15), warrenCentre(16)
+};
+
+// Weights of the other stencils: a boundary vertex (the previous boundary
+// vertex, itself, the next one) and an edge point (the ends, then the opposite
+// corners).
+static const float BoundaryVertexWeights[3] = { 1.0f/8.0f, 6.0f/8.0f, 1.0f/8.0f };
+static const float EdgeWeights[4] = { 3.0f/8.0f, 3.0f/8.0f, 1.0f/8.0f, 1.0f/8.0f };
+
+// Stencils with the same weights, collected from a mesh and evaluated
+// StencilBatchSize at a time. Tap t of stencil i is at taps[t*StencilBatchSize + i].
+template <unsigned int NumTaps>
+struct StencilBatch {
+    StencilBatch() : count(0) {}
+
+    inline unsigned int* nextTaps() { return taps + count; }
+    // Adds the stencil whose taps were written to nextTaps. Returns whether the batch is full.
+    inline bool add(unsigned int destination) {
+        dest[count++] = destination;
+        return count == StencilBatchSize;
+    }
+    // Evaluates the stencils and passes them to store(destination, x, y, z).
+    template <typename Store>
+    void flush(const Mesh& mesh, const float* weights, Store store) {
+        evaluateStencils(mesh.getVertexX(), mesh.getVertexY(), mesh.getVertexZ(),
+                         taps, StencilBatchSize, weights, NumTaps, count, x, y, z);
+        for (unsigned int i = 0; i < count; i++) {
+            store(dest[i], x[i], y[i], z[i]);
+        }
+        count = 0;
+    }
+
+    unsigned int taps[NumTaps * StencilBatchSize];
+    unsigned int dest[StencilBatchSize];
+    float x[StencilBatchSize], y[StencilBatchSize], z[StencilBatchSize];
+    unsigned int count;
+};
+
+// Taps of the vertex point of v, which has valence N, for Warren's weights: v,
+// then its ring in the order in which vertexPoint sums it. Returns false if an
+// outgoing HalfEdge is on the boundary.
+template <unsigned int N>
+static inline bool interiorVertexTaps(const Mesh& mesh, unsigned int v, unsigned int* taps) {
+    unsigned int currentEdge = mesh.out(v);
+
+    taps[0] = v;
+    for (unsigned int k = 1; k <= N; k++) {
+        if (mesh.face(currentEdge) == Mesh::NoIndex) {
+            return false;
+        }
+        taps[k * StencilBatchSize] = mesh.target(currentEdge);
+        currentEdge = mesh.next(mesh.twin(currentEdge));
+    }
+    return true;
+}
+
+template <unsigned int N>
+static inline void warrenWeights(float* weights) {
+    weights[0] = WarrenCentre[N];
+    for (unsigned int k = 1; k <= N; k++) {
+        weights[k] = WarrenBeta[N];
+    }
+}
+
+// Vertex points of interior vertices of valence N. The vertices that turn out
+// to be on the boundary are added to boundary.
+template <unsigned int N, typename Store>
+static void interiorVertexPoints(const Mesh& mesh, const QVector<unsigned int>& vertices, QVector<unsigned int>& boundary, Store store) {
+    StencilBatch<N + 1> batch;
+    float weights[N + 1];
+
+    warrenWeights<N>(weights);
+    for (int k = 0; k < vertices.size(); k++) {
+        if (!interiorVertexTaps<N>(mesh, vertices[k], batch.nextTaps())) {
+            boundary.append(vertices[k]);
+        } else if (batch.add(vertices[k])) {
+            batch.flush(mesh, weights, store);
+        }
+    }
+    batch.flush(mesh, weights, store);
+}
+
+// Boundary vertices move along the boundary curve. Vertices with only one of
+// the two boundary neighbours (non-manifold) keep the rules of vertexPoint.
+template <typename Store>
+static void boundaryVertexPoints(const Mesh& mesh, const QVector<unsigned int>& vertices, Store store) {
+    StencilBatch<3> batch;
+
+    for (int k = 0; k < vertices.size(); k++) {
+        unsigned int v = vertices[k];
+        unsigned int currentEdge = mesh.out(v);
+        unsigned int previousVertex = Mesh::NoIndex;
+        unsigned int nextVertex = Mesh::NoIndex;
+
+        for (unsigned short i = 0; i < mesh.valence(v); i++) {
+            if (mesh.face(currentEdge) == Mesh::NoIndex) {
+                nextVertex = mesh.target(currentEdge);
+            }
+            if (mesh.face(mesh.twin(currentEdge)) == Mesh::NoIndex) {
+                previousVertex = mesh.target(currentEdge);
+            }
+            currentEdge = mesh.next(mesh.twin(currentEdge));
+        }
+
+        if (previousVertex == Mesh::NoIndex || nextVertex == Mesh::NoIndex) {
+            QVector3D point = vertexPoint(mesh, mesh.out(v));
+            store(v, point.x(), point.y(), point.z());
+            continue;
+        }
+
+        unsigned int* taps = batch.nextTaps();
+        taps[0] = previousVertex;
+        taps[StencilBatchSize] = v;
+        taps[2 * StencilBatchSize] = nextVertex;
+        if (batch.add(v)) {
+            batch.flush(mesh, BoundaryVertexWeights, store);
+        }
+    }
+    batch.flush(mesh, BoundaryVertexWeights, store);
+}
+
+// Vertex points of [begin, end) of mesh, passed to store(v, x, y, z). The
+// vertices are sorted into buckets by valence and boundary, and every bucket is
+// evaluated with stencils of its own. Regular vertices (interior, valence 6),
+// nearly all of them after the first level, skip the buckets.
+template <typename Store>
+static void vertexPoints(const Mesh& mesh, unsigned int begin, unsigned int end, Store store) {
+    StencilBatch<7> regular;
+    float regularWeights[7];
+    QVector<unsigned int> byValence[MaxSpecializedValence + 1];
+    QVector<unsigned int> boundary;
+
+    warrenWeights<6>(regularWeights);
+
+    for (unsigned int v = begin; v < end; v++) {
+        unsigned short n = mesh.valence(v);
+
+        if (mesh.out(v) == Mesh::NoIndex) {
+            QVector3D point = mesh.coords(v);
+            store(v, point.x(), point.y(), point.z());
+        } else if (n == 6) {
+            if (!interiorVertexTaps<6>(mesh, v, regular.nextTaps())) {
+                boundary.append(v);
+            } else if (regular.add(v)) {
+                regular.flush(mesh, regularWeights, store);
+            }
+        } else if (n >= 3 && n <= MaxSpecializedValence) {
+            byValence[n].append(v);
+        } else {
+            QVector3D point = vertexPoint(mesh, mesh.out(v));
+            store(v, point.x(), point.y(), point.z());
+        }
+    }
+    regular.flush(mesh, regularWeights, store);
+
+    interiorVertexPoints<3>(mesh, byValence[3], boundary, store);
+    interiorVertexPoints<4>(mesh, byValence[4], boundary, store);
+    interiorVertexPoints<5>(mesh, byValence[5], boundary, store);
+    interiorVertexPoints<7>(mesh, byValence[7], boundary, store);
+    interiorVertexPoints<8>(mesh, byValence[8], boundary, store);
+    interiorVertexPoints<9>(mesh, byValence[9], boundary, store);
+    interiorVertexPoints<10>(mesh, byValence[10], boundary, store);
+    interiorVertexPoints<11>(mesh, byValence[11], boundary, store);
+    interiorVertexPoints<12>(mesh, byValence[12], boundary, store);
+    interiorVertexPoints<13>(mesh, byValence[13], boundary, store);
+    interiorVertexPoints<14>(mesh, byValence[14], boundary, store);
+    interiorVertexPoints<15>(mesh, byValence[15], boundary, store);
+    interiorVertexPoints<16>(mesh, byValence[16], boundary, store);
+
+    boundaryVertexPoints(mesh, boundary, store);
+}
+
+// Taps of the edge point of h for EdgeWeights. On the boundary the ends stand
+// in for the missing corners, which gives 1/2 for both.
+static inline void edgeTaps(const Mesh& mesh, unsigned int h, unsigned int* taps) {
+    unsigned int twinEdge = mesh.twin(h);
+
+    taps[0] = mesh.target(h);
+    taps[StencilBatchSize] = mesh.target(twinEdge);
+    if (mesh.face(h) == Mesh::NoIndex || mesh.face(twinEdge) == Mesh::NoIndex) {
+        taps[2 * StencilBatchSize] = taps[0];
+        taps[3 * StencilBatchSize] = taps[StencilBatchSize];
+    } else {
+        taps[2 * StencilBatchSize] = mesh.target(mesh.next(h));
+        taps[3 * StencilBatchSize] = mesh.target(mesh.next(twinEdge));
+    }
+}
+
+void Mesh::subdivideLoop(Mesh& mesh) const {
     unsigned int numVerts, numHalfEdges, numFaces;
-    unsigned int vIndex, hIndex, fIndex;
-    HalfEdge* currentEdge;
 
     qDebug() << ":: Creating new Loop mesh";
 
-    numVerts = vertices.size();
-    numHalfEdges = halfEdges.size();
-    numFaces = faces.size();
-
-    // Reserve memory
-    newVertices.reserve(numVerts + numHalfEdges / 2);
-    newHalfEdges.reserve(2*numHalfEdges + 6*numFaces);
-    newFaces.reserve(4*numFaces);
-
-    // Create vertex points
-    for (unsigned int k = 0; k < numVerts; k++) {
-        // Coords (x,y,z), Out, Valence, Index
-        newVertices.push_back( Vertex( vertexPoint(vertices[k].out),
-                                             nullptr,
-                                             vertices[k].val,
-                                             k) );
-    }
+    numVerts = numVertices();
+    numHalfEdges = this->numHalfEdges();
+    numFaces = this->numFaces();
+
+    // Allocate memory. Every HalfEdge has a twin, so there are numHalfEdges/2 edge points.
+    mesh.resizeVertices(numVerts + numHalfEdges / 2);
+
+    // Every output position only depends on this mesh, so both loops below run in
+    // parallel. They write through raw pointers into distinct slots.
+    const Mesh& parent = *this;
+    float* newX = mesh.vertexX.data();
+    float* newY = mesh.vertexY.data();
+    float* newZ = mesh.vertexZ.data();
+    unsigned short* newVal = mesh.vertexVal.data();
+
+    auto storePoint = [&](unsigned int v, float x, float y, float z) {
+        newX[v] = x;
+        newY[v] = y;
+        newZ[v] = z;
+    };
+
+    // Create vertex points, vectorized (see stencilkernels.h).
+    parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            newVal[k] = parent.valence(k);
+        }
+        vertexPoints(parent, begin, end, storePoint);
+    });
 
-    vIndex = numVerts;
     qDebug() << " * Created vertex points";
 
-    // Create edge points
-    for (unsigned int k = 0; k < numHalfEdges; k++) {
-        currentEdge = &halfEdges[k];
-
-        //only create a new vertex per set of halfEdges
-        if (k < currentEdge->twin->index) {
-            // Coords (x,y,z), Out, Valence, Index
-            newVertices.push_back( Vertex(edgePoint(currentEdge),
-                                                nullptr,
-                                                6,
-                                                vIndex) );
-            vIndex++;
+    // Create edge points, one per pair of HalfEdges.
+    QVector<unsigned int> edgeVertex;
+    numberEdgePoints(edgeVertex);
+    const unsigned int* edgeVertices = edgeVertex.constData();
+
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        StencilBatch<4> batch;
+        unsigned int vIndex;
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < parent.twin(k)) {
+                vIndex = edgeVertices[k];
+                edgeTaps(parent, k, batch.nextTaps());
+                if (batch.add(vIndex)) {
+                    batch.flush(parent, EdgeWeights, storePoint);
+                }
+                // Edge points on the boundary only have one face.
+                newVal[vIndex] = (parent.face(k) == NoIndex || parent.face(parent.twin(k)) == NoIndex) ? 4 : 6;
+            }
         }
-    }
+        batch.flush(parent, EdgeWeights, storePoint);
+    });
 
     qDebug() << " * Created edge points";
 
+    if (implicitTriangles) {
+        refineTriangles(mesh, edgeVertex);
+        qDebug() << " * Created faces";
+        return;
+    }
+
+    mesh.implicitTriangles = false;
+    mesh.implicitHalfEdges = 0;
+    mesh.resizeHalfEdges(2*numHalfEdges + 6*numFaces);
+    mesh.resizeFaces(4*numFaces);
+
     // Split halfedges
-    splitHalfEdges(newVertices, newHalfEdges);
+    splitHalfEdges(mesh, edgeVertex);
 
     qDebug() << " * Split halfedges";
 
-    hIndex = 2*numHalfEdges;
-    fIndex = 0;
+    // Create faces and remaining halfedges. Face k owns child faces 4k..4k+3 and the
+    // new HalfEdges 2*numHalfEdges + 6k.., and only touches the halves of its own
+    // HalfEdges, so the faces are built independently.
+    unsigned int* newTarget = mesh.halfEdgeTarget.data();
+    unsigned int* newNext = mesh.halfEdgeNext.data();
+    unsigned int* newTwin = mesh.halfEdgeTwin.data();
+    unsigned int* newFace = mesh.halfEdgeFace.data();
+    unsigned int* newSide = mesh.faceSide.data();
+    unsigned short* newFaceVal = mesh.faceVal.data();
+    unsigned int* newOut = mesh.vertexOut.data();
 
-    // Create faces and remaining halfedges
-    for (unsigned int k = 0; k < numFaces; k++) {
-        currentEdge = faces[k].side;
+    parallelFor(numFaces, [&](unsigned int begin, unsigned int end) {
+        unsigned int hIndex, fIndex, currentEdge, s, t;
 
-        // Three outer faces
+        for (unsigned int k = begin; k < end; k++) {
+            hIndex = 2*numHalfEdges + 6*k;
+            fIndex = 4*k;
+            currentEdge = parent.side(k);
 
-        for (unsigned int m = 0; m < 3; m++) {
+            // Three outer faces
 
-            unsigned int s = currentEdge->prev->index;
-            unsigned int t = currentEdge->index;
+            for (unsigned int m = 0; m < 3; m++) {
 
-            // Side, Val, Index
-            newFaces.push_back( Face(nullptr,
-                                3,
-                                fIndex) );
+                s = parent.prev(currentEdge);
+                t = currentEdge;
 
-            newFaces[fIndex].side = &newHalfEdges[ 2*t ];
+                newSide[fIndex] = 2*t;
+                newFaceVal[fIndex] = 3;
 
-            // Target, Next, Prev, Twin, Poly, Index
-            newHalfEdges.append(HalfEdge( newHalfEdges[2*s].target,
-                                         &newHalfEdges[2*s+1],
-                    &newHalfEdges[ 2*t ],
-                    nullptr,
-                    &newFaces[fIndex],
-                    hIndex ));
+                // Target, Next, Twin, Face
+                newTarget[hIndex] = edgeVertices[s];
+                newNext[hIndex] = 2*s+1;
+                newTwin[hIndex] = hIndex+1;
+                newFace[hIndex] = fIndex;
 
-            newHalfEdges.append(HalfEdge( newHalfEdges[2*t].target,
-                                         nullptr,
-                                         nullptr,
-                                         &newHalfEdges[hIndex],
-                                         nullptr,
-                                         hIndex+1 ));
+                // Next and Face are assigned with the inner face below.
+                newTarget[hIndex+1] = edgeVertices[t];
+                newTwin[hIndex+1] = hIndex;
 
-            newHalfEdges[hIndex].twin = &newHalfEdges[hIndex+1];
+                newNext[2*s+1] = 2*t;
+                newFace[2*s+1] = fIndex;
 
-            newHalfEdges[2*s+1].next = &newHalfEdges[2*t];
-            newHalfEdges[2*s+1].prev = &newHalfEdges[hIndex];
-            newHalfEdges[2*s+1].polygon = &newFaces[fIndex];
+                newNext[2*t] = hIndex;
+                newFace[2*t] = fIndex;
 
-            newHalfEdges[2*t].next = &newHalfEdges[hIndex];
-            newHalfEdges[2*t].prev = &newHalfEdges[2*s+1];
-            newHalfEdges[2*t].polygon = &newFaces[fIndex];
+                // For edge points, set by one of the two faces only.
+                if (t < parent.twin(t) || parent.face(parent.twin(t)) == NoIndex) {
+                    newOut[edgeVertices[t]] = hIndex;
+                }
 
-            // For edge points
-            newHalfEdges[2*t].target->out = &newHalfEdges[hIndex];
+                hIndex += 2;
+                fIndex++;
+                currentEdge = parent.next(currentEdge);
+
+            }
+
+            // Inner face
+            newSide[fIndex] = hIndex - 1;
+            newFaceVal[fIndex] = 3;
+
+            for (unsigned int m = 0; m < 3; m++) {
+                newNext[hIndex - 5 + 2*m] = (m == 2) ? hIndex - 5 : hIndex - 5 + 2*(m+1);
+                newFace[hIndex - 5 + 2*m] = fIndex;
+            }
+        }
+    });
 
-            hIndex += 2;
-            fIndex++;
-            currentEdge = currentEdge->next;
+    qDebug() << " * Created faces";
 
+    // Outs of the vertex points. Isolated vertices can make them outnumber the
+    // HalfEdges, so they get their own loop.
+    parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            newOut[k] = parent.out(k) == NoIndex ? NoIndex : 2 * parent.out(k);
+        }
+    });
+
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            // Connect the split boundary HalfEdges, the old boundary loops give the order directly.
+            if (parent.face(k) == NoIndex) {
+                newNext[2*k] = 2*k+1;
+                newNext[2*k+1] = 2*parent.next(k);
+            }
         }
+    });
+}
 
-        // Inner face
-        // Side, Val, Index
-        newFaces.append(Face(&newHalfEdges[ hIndex-1 ], 3, fIndex));
+// Numbers the edge points: one per pair of HalfEdges (the one with k < twin), in
+// HalfEdge order after the vertex points. Counting them per chunk first gives
+// every chunk its first index, so the numbering does not depend on the number
+// of threads. edgeVertex gets the edge point of every HalfEdge.
+void Mesh::numberEdgePoints(QVector<unsigned int>& edgeVertex) const {
+    unsigned int numHalfEdges = this->numHalfEdges();
+    unsigned int numChunks = parallelChunks(numHalfEdges);
+    QVector<unsigned int> chunkStart(numChunks + 1);
+    const Mesh& parent = *this;
+
+    edgeVertex.resize(numHalfEdges);
+    unsigned int* edgeVertices = edgeVertex.data();
+    unsigned int* chunkStarts = chunkStart.data();
+
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int count = 0;
+        for (unsigned int k = begin; k < end; k++) {
+            count += k < parent.twin(k);
+        }
+        chunkStarts[chunk + 1] = count;
+    });
 
-        for (unsigned int m = 0; m < 3; m++) {
+    chunkStart[0] = numVertices();
+    for (unsigned int c = 0; c < numChunks; c++) {
+        chunkStart[c + 1] += chunkStart[c];
+    }
 
-            if (m == 2) {
-                newHalfEdges[hIndex - 1].next = &newHalfEdges[hIndex - 5];
-            } else {
-                newHalfEdges[hIndex - 5 + 2*m].next = &newHalfEdges[hIndex - 5 + 2*(m+1)];
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int vIndex = chunkStarts[chunk];
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < parent.twin(k)) {
+                edgeVertices[k] = vIndex;
+                vIndex++;
             }
+        }
+    });
 
-            if (m == 0) {
-                newHalfEdges[hIndex - 5].prev = &newHalfEdges[hIndex - 1];
-            } else {
-                newHalfEdges[hIndex - 5 + 2*m].prev = &newHalfEdges[hIndex - 5 + 2*(m-1)];
+    // The other HalfEdge of every pair shares the edge point.
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            if (k > parent.twin(k)) {
+                edgeVertices[k] = edgeVertices[parent.twin(k)];
             }
+        }
+    });
+}
 
-            newHalfEdges[hIndex - 5 + 2*m].polygon = &newFaces[fIndex];
+void Mesh::extractEdges(QVector<unsigned int>& edges) const {
+    QVector<unsigned int> edgeVertex;
+    const Mesh& mesh = *this;
 
+    numberEdgePoints(edgeVertex);
+    edges.resize(numHalfEdges());
+
+    const unsigned int* edgeVertices = edgeVertex.constData();
+    unsigned int* lines = edges.data();
+    unsigned int numVerts = numVertices();
+
+    parallelFor(numHalfEdges(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < mesh.twin(k)) {
+                unsigned int e = edgeVertices[k] - numVerts;
+                lines[2*e] = mesh.target(mesh.twin(k));
+                lines[2*e + 1] = mesh.target(k);
+            }
         }
+    });
+}
 
-        fIndex++;
+// Normal of triangle (p, a, b) weighted at corner p as computeVertexNormal
+// weighs it: by the angle at p, or (Area and Fast) by twice the area.
+static inline QVector3D cornerNormal(const QVector3D& p, const QVector3D& a, const QVector3D& b, NormalWeighting weighting) {
+    if (weighting != NormalWeighting::Angle) {
+        return QVector3D::crossProduct(a - p, b - p);
+    }
 
+    float cosAngle = QVector3D::dotProduct((a - p).normalized(), (b - p).normalized());
+    QVector3D normal = QVector3D::crossProduct(a - p, b - p);
+    float length = normal.length();
+
+    // Divided by hand like in computeFaceNormal, normalized() gives up on small faces.
+    if (length == 0.0f) {
+        return QVector3D();
     }
+    return acos(fmin(1.0, fmax(-1.0, cosAngle))) / length * normal;
+}
 
-    qDebug() << " * Created faces";
+// Only the three arrays are written, so the HalfEdges of the new level never
+// exist. Corner face i of face f is (T_i, e_{i+1}, e_i) and the inner face
+// (e_1, e_2, e_0), with T_i the target of side i and e_i its edge point, as in
+// refineTriangles. The normal of a new vertex is gathered from the new faces
+// around it, which are found through the faces of this mesh. The edges are the
+// two halves of every edge of this mesh, then the three inner edges of every
+// face.
+void Mesh::subdivideLoopAttributes(QVector<QVector3D>& coords, QVector<QVector3D>& normals, QVector<unsigned int>& indices, QVector<unsigned int>& edges,
+                                   NormalWeighting weighting) const {
+    unsigned int numVerts = numVertices();
+    unsigned int numHalfEdges = this->numHalfEdges();
+    unsigned int numFaces = this->numFaces();
+    const Mesh& parent = *this;
+
+    qDebug() << ":: Creating render attributes of the next Loop level";
+
+    QVector<unsigned int> edgeVertex;
+    numberEdgePoints(edgeVertex);
+    const unsigned int* edgeVertices = edgeVertex.constData();
+
+    coords.resize(numVerts + numHalfEdges / 2);
+    normals.resize(numVerts + numHalfEdges / 2);
+    indices.resize(12 * numFaces);
+    edges.resize(2 * numHalfEdges + 6 * numFaces);
+    QVector3D* points = coords.data();
+    QVector3D* vertexNormal = normals.data();
+    unsigned int* triangles = indices.data();
+    unsigned int* lines = edges.data();
+
+    auto storePoint = [&](unsigned int v, float x, float y, float z) {
+        points[v] = QVector3D(x, y, z);
+    };
+
+    // Vertex and edge points as in subdivideLoop.
+    parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+        vertexPoints(parent, begin, end, storePoint);
+    });
+
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        StencilBatch<4> batch;
+        unsigned int* l;
+
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < parent.twin(k)) {
+                edgeTaps(parent, k, batch.nextTaps());
+                if (batch.add(edgeVertices[k])) {
+                    batch.flush(parent, EdgeWeights, storePoint);
+                }
 
+                l = lines + 4*(edgeVertices[k] - numVerts);
+                l[0] = parent.target(parent.twin(k));
+                l[1] = edgeVertices[k];
+                l[2] = edgeVertices[k];
+                l[3] = parent.target(k);
+            }
+        }
+        batch.flush(parent, EdgeWeights, storePoint);
+    });
 
+    qDebug() << " * Created vertex and edge points";
 
-    // set outs for updated vertices
-    for (unsigned int k = 0; k < numVerts; k++) {
-        newVertices[k].out = &newHalfEdges[ 2 * vertices[k].out->index ];
-    }
+    parallelFor(numFaces, [&](unsigned int begin, unsigned int end) {
+        unsigned int h[3], e[3];
+        unsigned int* t;
 
+        for (unsigned int f = begin; f < end; f++) {
+            h[0] = parent.side(f);
+            h[1] = parent.next(h[0]);
+            h[2] = parent.next(h[1]);
+            for (unsigned int i = 0; i < 3; i++) {
+                e[i] = edgeVertices[h[i]];
+            }
 
-    // Fix up all the edgeloops
-    for (HalfEdge& edge : newHalfEdges) {
-        if (not edge.next && not edge.polygon) {           
-            // We need to repair this halfedge since it's on the boundary
-            HalfEdge* currentEdge = edge.twin;
+            t = triangles + 12*f;
+            for (unsigned int i = 0; i < 3; i++) {
+                t[3*i] = parent.target(h[i]);
+                t[3*i + 1] = e[(i + 1) % 3];
+                t[3*i + 2] = e[i];
+            }
+            t[9] = e[1];
+            t[10] = e[2];
+            t[11] = e[0];
+
+            t = lines + 2*numHalfEdges + 6*f;
+            for (unsigned int i = 0; i < 3; i++) {
+                t[2*i] = e[i];
+                t[2*i + 1] = e[(i + 1) % 3];
+            }
+        }
+    });
+
+    // A vertex point touches the corner face at its vertex in every face around it.
+    parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+        unsigned int currentEdge;
+        QVector3D normal;
+
+        for (unsigned int k = begin; k < end; k++) {
+            normal = QVector3D();
+            currentEdge = parent.out(k);
+            for (unsigned short m = 0; currentEdge != NoIndex && m < parent.valence(k); m++) {
+                if (parent.face(currentEdge) != NoIndex) {
+                    normal += cornerNormal(points[k], points[edgeVertices[currentEdge]], points[edgeVertices[parent.prev(currentEdge)]], weighting);
+                }
+                currentEdge = parent.next(parent.twin(currentEdge));
+            }
+            vertexNormal[k] = normal;
+        }
+    });
 
-            // Iterate over the disc around edge.target and find the previous edge
-            while (currentEdge->prev != nullptr) {
-                currentEdge = currentEdge->prev->twin;
+    // An edge point touches both corner faces at its edge and the inner face, on
+    // either side of the edge.
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        unsigned int h, hNext, hPrev;
+        QVector3D normal, p;
+
+        for (unsigned int k = begin; k < end; k++) {
+            if (k > parent.twin(k)) {
+                continue;
             }
 
-            // Connect the edges, effectively creating (a) boundary loop(s) once all halfedges have been fixed.
-            edge.next = currentEdge;
-            currentEdge->prev = &edge;
+            normal = QVector3D();
+            p = points[edgeVertices[k]];
+            for (unsigned int m = 0; m < 2; m++) {
+                h = m == 0 ? k : parent.twin(k);
+                if (parent.face(h) == NoIndex) {
+                    continue;
+                }
+                hNext = parent.next(h);
+                hPrev = parent.prev(h);
+                normal += cornerNormal(p, points[parent.target(h)], points[edgeVertices[hNext]], weighting);
+                normal += cornerNormal(p, points[edgeVertices[hPrev]], points[parent.target(hPrev)], weighting);
+                normal += cornerNormal(p, points[edgeVertices[hNext]], points[edgeVertices[hPrev]], weighting);
+            }
+            vertexNormal[edgeVertices[k]] = normal;
         }
-    }
+    });
+
+    qDebug() << " * Created faces and normals";
+}
+
+// Topology of the refined mesh for a parent with implicit triangles. Corner face i
+// of face f becomes child face 4f+i, the inner face 4f+3. Vertex and edge points
+// must already be in place; edgeVertex holds the edge point on every HalfEdge.
+// Every parent face and boundary HalfEdge writes its own fixed output slots, so
+// all loops run in parallel.
+void Mesh::refineTriangles(Mesh& mesh, const QVector<unsigned int>& edgeVertex) const {
+    unsigned int numVerts = numVertices();
+    unsigned int numHalfEdges = this->numHalfEdges();
+    unsigned int numFaces = this->numFaces();
+    unsigned int numBoundary = numHalfEdges - implicitHalfEdges;
+
+    mesh.implicitTriangles = true;
+    mesh.implicitHalfEdges = 4*implicitHalfEdges;
+    mesh.resizeHalfEdges(4*implicitHalfEdges + 2*numBoundary);
+
+    const Mesh& parent = *this;
+    const unsigned int* edgeVertices = edgeVertex.constData();
+    unsigned int* newTarget = mesh.halfEdgeTarget.data();
+    unsigned int* newTwin = mesh.halfEdgeTwin.data();
+    unsigned int* newNext = mesh.halfEdgeNext.data();
+    unsigned int* newFace = mesh.halfEdgeFace.data();
+    unsigned int* newOut = mesh.vertexOut.data();
+    unsigned int newBoundary = mesh.implicitHalfEdges;
+
+    parallelFor(numFaces, [&](unsigned int begin, unsigned int end) {
+        unsigned int h, hNext, c, inner;
+
+        for (unsigned int f = begin; f < end; f++) {
+            inner = 3*(4*f + 3);
+
+            for (unsigned int i = 0; i < 3; i++) {
+                h = 3*f + i;
+                hNext = 3*f + (i + 1) % 3;
+                c = 3*(4*f + i);
+
+                // Second half of h, from its edge point to its target
+                newTarget[c] = parent.target(h);
+                newTwin[c] = parent.firstHalf(parent.twin(h));
+
+                // First half of hNext
+                newTarget[c+1] = edgeVertices[hNext];
+                newTwin[c+1] = parent.secondHalf(parent.twin(hNext));
+
+                // Between the two edge points, twin of side i of the inner face
+                newTarget[c+2] = edgeVertices[h];
+                newTwin[c+2] = inner + i;
+
+                newTarget[inner + i] = edgeVertices[hNext];
+                newTwin[inner + i] = c + 2;
+            }
+        }
+    });
+
+    // Every boundary HalfEdge is split in two, in the order of their parents.
+    parallelFor(numBoundary, [&](unsigned int begin, unsigned int end) {
+        unsigned int b, h;
+
+        for (unsigned int k = begin; k < end; k++) {
+            b = implicitHalfEdges + k;
+            h = newBoundary + 2*k;
+
+            newTarget[h] = edgeVertices[b];
+            newTwin[h] = parent.secondHalf(parent.twin(b));
+            newNext[2*k] = h + 1;
+            newFace[2*k] = NoIndex;
+
+            newTarget[h+1] = parent.target(b);
+            newTwin[h+1] = parent.firstHalf(parent.twin(b));
+            newNext[2*k+1] = parent.firstHalf(parent.next(b));
+            newFace[2*k+1] = NoIndex;
+        }
+    });
+
+    // Outs of the vertex points, which may outnumber the HalfEdges (isolated
+    // vertices), and of the edge points on their owning HalfEdge
+    parallelFor(numVerts, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            newOut[k] = parent.out(k) == NoIndex ? NoIndex : parent.firstHalf(parent.out(k));
+        }
+    });
+
+    parallelFor(numHalfEdges, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < parent.twin(k)) {
+                newOut[edgeVertices[k]] = parent.secondHalf(k);
+            }
+        }
+    });
 }
 
 // ---
 
-QVector3D vertexPoint(HalfEdge* firstEdge) {
+QVector3D vertexPoint(const Mesh& mesh, unsigned int firstEdge) {
     unsigned short k, n;
-    QVector3D sumStarPts, sumFacePts;
+    QVector3D sumStarPts;
     QVector3D vertexPt;
     float stencilValue;
-    HalfEdge* currentEdge;
-    Vertex* currentVertex;
-
+    unsigned int currentEdge;
+    unsigned int currentVertex;
 
-    currentVertex = firstEdge->twin->target;
-    n = currentVertex->val;
+    currentVertex = mesh.target(mesh.twin(firstEdge));
+    n = mesh.valence(currentVertex);
 
-    Vertex* previousVertex = nullptr;
-    Vertex* nextVertex = nullptr;
+    unsigned int previousVertex = Mesh::NoIndex;
+    unsigned int nextVertex = Mesh::NoIndex;
 
     // Figure out if we have a face without polygon of which our vertex is a part of.
 
     currentEdge = firstEdge;
-    currentVertex = firstEdge->twin->target;
-
-    // Iterate around the vertex to find next and previous halfedges in case of a boundary edge.
-    // Effectively we do this for both directions, to find the previous and next boundary halfedges if any.
-    for(int k = 0; k < currentVertex->val; ++k) {
-        if (not currentEdge->polygon) {
-            //set previous
-            previousVertex = currentEdge->target;
-            currentEdge = currentEdge->twin;
-            for(int j = 0; j < currentVertex->val; ++j) {
-
-                if (not currentEdge->polygon) {
-                    nextVertex = currentEdge->twin->target;
-                    break;
-                } else {
-                    currentEdge = currentEdge->next->twin;
-                }
-
-            }
 
-            break;
-        } else {
-            currentEdge = currentEdge->prev->twin;
+    // Iterate around the vertex to find next and previous vertices in case of a boundary.
+    // The outgoing boundary HalfEdge points at the next one, the outgoing HalfEdge with a
+    // boundary twin at the previous one.
+    for (k = 0; k < n; k++) {
+        if (mesh.face(currentEdge) == Mesh::NoIndex) {
+            nextVertex = mesh.target(currentEdge);
+        }
+        if (mesh.face(mesh.twin(currentEdge)) == Mesh::NoIndex) {
+            previousVertex = mesh.target(currentEdge);
         }
+        currentEdge = mesh.next(mesh.twin(currentEdge));
     }
     // In case of boundary edges we basically weight the vertices based on current, prev and next vertices.
     // Thus we apply this: v0 --- v1 --- v2  with a weighting of 1/8 3/4 1.8. (normalized, v1 is the one we adjust)
     // This ONLY happens when the vertices are at a boundary!
     // Otherwise we apply warren's rules. (See below)
-    if(previousVertex != nullptr && nextVertex != nullptr) {
+    if (previousVertex != Mesh::NoIndex && nextVertex != Mesh::NoIndex) {
         QVector3D coords;
-        coords = previousVertex->coords;
-        coords += 6 * currentVertex->coords;
-        coords += nextVertex->coords;
+        coords = mesh.coords(previousVertex);
+        coords += 6 * mesh.coords(currentVertex);
+        coords += mesh.coords(nextVertex);
         coords /= 8;
         return coords;
     }
 
 
     sumStarPts = QVector3D();
-    sumFacePts = QVector3D();
     currentEdge = firstEdge;
 
     for (k=0; k<n; k++) {
-        sumStarPts += currentEdge->target->coords;
-        currentEdge = currentEdge->prev->twin;
+        sumStarPts += mesh.coords(mesh.target(currentEdge));
+        currentEdge = mesh.next(mesh.twin(currentEdge));
     }
 
     // Warren's rules
@@ -239,36 +757,36 @@ QVector3D vertexPoint(HalfEdge* firstEdge) {
         stencilValue = 3.0/(8*n);
     }
 
-    vertexPt = (1.0 - n*stencilValue) * currentVertex->coords + stencilValue * sumStarPts;
+    vertexPt = (1.0 - n*stencilValue) * mesh.coords(currentVertex) + stencilValue * sumStarPts;
 
 
     return vertexPt;
 
 }
 
-QVector3D edgePoint(HalfEdge* firstEdge) {
+QVector3D edgePoint(const Mesh& mesh, unsigned int firstEdge) {
     QVector3D EdgePt;
-    HalfEdge* currentEdge;
+    unsigned int currentEdge, twinEdge;
 
-    EdgePt = QVector3D();
     currentEdge = firstEdge;
+    twinEdge = mesh.twin(currentEdge);
 
     EdgePt = QVector3D();
     // If no polygon we are at a boundary.
-    if (currentEdge->twin->polygon == nullptr) {
+    if (mesh.face(twinEdge) == Mesh::NoIndex || mesh.face(currentEdge) == Mesh::NoIndex) {
         // Boundary update rules
 
         // Take 2 points next to the new point and weigh them equally
-        EdgePt = 0.5 * currentEdge->target->coords;
-        EdgePt += 0.5 * currentEdge->twin->target->coords;
+        EdgePt = 0.5 * mesh.coords(mesh.target(currentEdge));
+        EdgePt += 0.5 * mesh.coords(mesh.target(twinEdge));
 
     } else {
         // Regular update rules 2 6 6 2
 
-        EdgePt  = 6.0 * currentEdge->target->coords;
-        EdgePt += 2.0 * currentEdge->next->target->coords;
-        EdgePt += 6.0 * currentEdge->twin->target->coords;
-        EdgePt += 2.0 * currentEdge->twin->next->target->coords;
+        EdgePt  = 6.0 * mesh.coords(mesh.target(currentEdge));
+        EdgePt += 2.0 * mesh.coords(mesh.target(mesh.next(currentEdge)));
+        EdgePt += 6.0 * mesh.coords(mesh.target(twinEdge));
+        EdgePt += 2.0 * mesh.coords(mesh.target(mesh.next(twinEdge)));
         EdgePt /= 16.0;
     }
 
@@ -276,45 +794,200 @@ QVector3D edgePoint(HalfEdge* firstEdge) {
 
 }
 
-void Mesh::splitHalfEdges(QVector<Vertex>& newVertices, QVector<HalfEdge>& newHalfEdges) {
-    unsigned int vIndex = vertices.size();
-
-    for (unsigned int k = 0; k < halfEdges.size(); ++k) {
-        HalfEdge* currentEdge = &halfEdges[k];
-        unsigned int m = currentEdge->twin->index;
-
-        // Target, Next, Prev, Twin, Poly, Index
-        newHalfEdges.append(HalfEdge(nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              2*k));
-
-        newHalfEdges.append(HalfEdge(nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              nullptr,
-                                              2*k+1));
-
-        if (k < m) {
-            newHalfEdges[2*k].target = &newVertices[ vIndex ];
-            newHalfEdges[2*k+1].target = &newVertices[ currentEdge->target->index ];
-            vIndex++;
+// One-ring of the vertex at the tail of firstEdge, in the order of the rotation
+// next(twin(h)). On a boundary the ring starts at the outgoing boundary HalfEdge,
+// so it runs from the next to the previous boundary vertex. Returns whether the
+// vertex is on a boundary.
+static bool oneRing(const Mesh& mesh, unsigned int firstEdge, QVarLengthArray<QVector3D, 16>& ring) {
+    unsigned short n = mesh.valence(mesh.target(mesh.twin(firstEdge)));
+    unsigned int currentEdge = firstEdge;
+    bool boundary = false;
+
+    for (unsigned short k = 0; k < n && !boundary; k++) {
+        if (mesh.face(currentEdge) == Mesh::NoIndex) {
+            firstEdge = currentEdge;
+            boundary = true;
         }
-        else {
-            newHalfEdges[2*k].target = newHalfEdges[2*m].target;
-            newHalfEdges[2*k+1].target = &newVertices[ currentEdge->target->index ];
-
-            // Assign Twinss
-            newHalfEdges[2*k].twin = &newHalfEdges[2*m+1];
-            newHalfEdges[2*k+1].twin = &newHalfEdges[2*m];
-            newHalfEdges[2*m].twin = &newHalfEdges[2*k+1];
-            newHalfEdges[2*m+1].twin = &newHalfEdges[2*k];
+        currentEdge = mesh.next(mesh.twin(currentEdge));
+    }
+
+    ring.resize(n);
+    currentEdge = firstEdge;
+
+    for (unsigned short k = 0; k < n; k++) {
+        ring[k] = mesh.coords(mesh.target(currentEdge));
+        if (k + 1 < n) {
+            currentEdge = mesh.next(mesh.twin(currentEdge));
+        }
+    }
+
+    // The last HalfEdge of a boundary ring has a boundary twin, unless the vertex is non-manifold.
+    return boundary && mesh.face(mesh.twin(currentEdge)) == Mesh::NoIndex;
+}
+
+// Position of the vertex on the limit surface. Interior vertices use the limit
+// mask belonging to Warren's weights, boundary vertices the limit of the cubic
+// B-spline boundary curve (1 4 1).
+QVector3D limitPoint(const Mesh& mesh, unsigned int firstEdge) {
+    QVarLengthArray<QVector3D, 16> ring;
+    QVector3D p = mesh.coords(mesh.target(mesh.twin(firstEdge)));
+
+    if (oneRing(mesh, firstEdge, ring)) {
+        return (ring[0] + 4.0 * p + ring[ring.size() - 1]) / 6.0;
+    }
+
+    unsigned short n = ring.size();
+    float stencilValue = (n == 3) ? 3.0/16.0 : 3.0/(8*n);
+    // 1 / (3/(8 stencilValue) + n)
+    float limitValue = 1.0 / (3.0 / (8.0 * stencilValue) + n);
+    QVector3D sumStarPts;
+
+    for (unsigned short k = 0; k < n; k++) {
+        sumStarPts += ring[k];
+    }
+
+    return (1.0 - n * limitValue) * p + limitValue * sumStarPts;
+}
+
+// Normal of the limit surface, the cross product of the two limit tangents.
+// Interior vertices use the cosine and sine masks, boundary vertices the masks
+// along and across the boundary of Hoppe et al. (1994).
+QVector3D limitNormal(const Mesh& mesh, unsigned int firstEdge) {
+    QVarLengthArray<QVector3D, 16> ring;
+    QVector3D p = mesh.coords(mesh.target(mesh.twin(firstEdge)));
+    QVector3D along, across;
+    unsigned short n;
+
+    if (oneRing(mesh, firstEdge, ring)) {
+        // ring[0] .. ring[k] around k faces.
+        unsigned short k = ring.size() - 1;
+        along = ring[0] - ring[k];
+
+        // Pointing away from the faces, like the general mask.
+        if (k == 1) {
+            across = 2.0 * p - ring[0] - ring[1];
+        } else if (k == 2) {
+            across = p - ring[1];
+        } else {
+            float theta = M_PI / k;
+            across = sin(theta) * (ring[0] + ring[k]);
+            for (unsigned short m = 1; m < k; m++) {
+                across += (2.0 * cos(theta) - 2.0) * sin(m * theta) * ring[m];
+            }
         }
+
+        return QVector3D::crossProduct(along.normalized(), across.normalized()).normalized();
+    }
+
+    n = ring.size();
+    for (unsigned short k = 0; k < n; k++) {
+        along += cos(2.0 * M_PI * k / n) * ring[k];
+        across += sin(2.0 * M_PI * k / n) * ring[k];
     }
 
-    // Note that Next, Prev and Poly are not yet assigned at this point.
+    // The rotation runs clockwise around the vertex. The tangents shrink with the
+    // edges, so they are normalized before the cross product.
+    return QVector3D::crossProduct(across.normalized(), along.normalized()).normalized();
+}
+
+// Splits HalfEdge k into 2k (tail to edge point) and 2k+1 (edge point to target).
+// Every k only writes its own two halves, so this runs in parallel.
+void Mesh::splitHalfEdges(Mesh& mesh, const QVector<unsigned int>& edgeVertex) const {
+    const Mesh& parent = *this;
+    const unsigned int* edgeVertices = edgeVertex.constData();
+    unsigned int* newTarget = mesh.halfEdgeTarget.data();
+    unsigned int* newNext = mesh.halfEdgeNext.data();
+    unsigned int* newTwin = mesh.halfEdgeTwin.data();
+    unsigned int* newFace = mesh.halfEdgeFace.data();
+
+    parallelFor(numHalfEdges(), [&](unsigned int begin, unsigned int end) {
+        unsigned int m;
+
+        for (unsigned int k = begin; k < end; ++k) {
+            m = parent.twin(k);
+
+            // Next and Face are not known yet.
+            newNext[2*k] = NoIndex;
+            newNext[2*k+1] = NoIndex;
+            newFace[2*k] = NoIndex;
+            newFace[2*k+1] = NoIndex;
+
+            newTarget[2*k] = edgeVertices[k];
+            newTarget[2*k+1] = parent.target(k);
+
+            // Assign Twins
+            newTwin[2*k] = 2*m+1;
+            newTwin[2*k+1] = 2*m;
+        }
+    });
+
+    // Note that Next and Face are only assigned for the new faces in subdivideLoop.
+
+}
+
+void moveVertex(QVector<Mesh>& levels, unsigned int v, const QVector3D& position, QVector<QVector<unsigned int> >& changed) {
+    QVector<unsigned int> edges;
+    unsigned int currentEdge;
+
+    changed.resize(levels.size());
+    changed[0].clear();
+    changed[0].append(v);
+    levels[0].setCoords(v, position);
+    levels[0].invalidateAttributes();
+
+    for (int l = 0; l + 1 < levels.size() && levels[l + 1].numVertices() > 0; l++) {
+        const Mesh& mesh = levels[l];
+        Mesh& child = levels[l + 1];
+        const QVector<unsigned int>& moved = changed[l];
+        QVector<unsigned int>& childMoved = changed[l + 1];
+
+        child.unshare();
+        child.invalidateAttributes();
+
+        // The vertex points of the moved vertices and their neighbours, the edge
+        // points of the edges around them and of the edges opposite to them.
+        childMoved.clear();
+        edges.clear();
+        for (int k = 0; k < moved.size(); k++) {
+            childMoved.append(moved[k]);
+            currentEdge = mesh.out(moved[k]);
+            for (unsigned short m = 0; currentEdge != Mesh::NoIndex && m < mesh.valence(moved[k]); m++) {
+                childMoved.append(mesh.target(currentEdge));
+                edges.append(qMin(currentEdge, mesh.twin(currentEdge)));
+                if (mesh.face(currentEdge) != Mesh::NoIndex) {
+                    unsigned int opposite = mesh.next(currentEdge);
+                    edges.append(qMin(opposite, mesh.twin(opposite)));
+                }
+                currentEdge = mesh.next(mesh.twin(currentEdge));
+            }
+        }
 
+        std::sort(childMoved.begin(), childMoved.end());
+        childMoved.erase(std::unique(childMoved.begin(), childMoved.end()), childMoved.end());
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        // Edge points are numbered after all vertex points, so appending them
+        // keeps the list sorted once they are sorted among themselves.
+        int numVertexPoints = childMoved.size();
+        childMoved.resize(numVertexPoints + edges.size());
+        unsigned int* childVertices = childMoved.data();
+
+        parallelFor(numVertexPoints, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                unsigned int u = childVertices[k];
+                child.setCoords(u, mesh.out(u) == Mesh::NoIndex ? mesh.coords(u) : vertexPoint(mesh, mesh.out(u)));
+            }
+        }, 256);
+
+        parallelFor(edges.size(), [&](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++) {
+                unsigned int u = mesh.childEdgePoint(child, edges[k]);
+                child.setCoords(u, edgePoint(mesh, edges[k]));
+                childVertices[numVertexPoints + k] = u;
+            }
+        }, 256);
+
+        std::sort(childMoved.begin() + numVertexPoints, childMoved.end());
+    }
 }
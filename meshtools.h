@@ -4,8 +4,18 @@
 #include "mesh.h"
 #include <QVector3D>
 
-QVector3D vertexPoint(HalfEdge* firstEdge);
-QVector3D edgePoint(HalfEdge* firstEdge);
+QVector3D vertexPoint(const Mesh& mesh, unsigned int firstEdge);
+QVector3D edgePoint(const Mesh& mesh, unsigned int firstEdge);
 
+// Loop limit surface at the tail of firstEdge.
+QVector3D limitPoint(const Mesh& mesh, unsigned int firstEdge);
+QVector3D limitNormal(const Mesh& mesh, unsigned int firstEdge);
+
+// Moves vertex v of levels[0] to position and updates the later levels, which
+// subdivideLoop made from it, where they depend on v: the support grows by one
+// ring per level. changed[l] lists the vertices of level l that moved, sorted.
+// Stops at the first empty level (evicted from a LevelCache); the levels after
+// it are left as they are.
+void moveVertex(QVector<Mesh>& levels, unsigned int v, const QVector3D& position, QVector<QVector<unsigned int> >& changed);
 
 #endif // MESHTOOLS_H
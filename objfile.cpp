@@ -1,8 +1,230 @@
 #include "objfile.h"
+#include "parallel.h"
 
 #include <QDebug>
 #include <QFile>
 
+#include <algorithm>
+
+// The file is memory mapped (or read at once if that is not possible) and
+// parsed in place. Numbers are converted by the helpers below, which do not
+// depend on the locale and never allocate.
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static inline const char* skipLine(const char* p, const char* end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+// Parses [-+]digits[.digits][(e|E)[-+]digits]. Up to 19 significant digits are
+// used; with at most 15 of them and a small exponent, as written by the usual
+// exporters, the result is the correctly rounded double converted to float.
+static const char* parseFloat(const char* p, const char* end, float& value) {
+    bool negative = false;
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    for (; p < end && isDigit(*p); p++) {
+        if (digits < 19) {
+            mantissa = 10 * mantissa + (*p - '0');
+            digits += mantissa > 0;
+        } else {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++) {
+            if (digits < 19) {
+                mantissa = 10 * mantissa + (*p - '0');
+                digits += mantissa > 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        bool negativeExponent = false;
+        int e = 0;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        for (; p < end && isDigit(*p); p++) {
+            if (e < 10000) {
+                e = 10 * e + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double result = double(mantissa);
+
+    while (exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+
+    value = float(negative ? -result : result);
+    return p;
+}
+
+static inline const char* parseIndex(const char* p, const char* end, unsigned int& value) {
+    value = 0;
+    for (; p < end && isDigit(*p); p++) {
+        value = 10 * value + (*p - '0');
+    }
+    return p;
+}
+
+// Result of parsing one part of a file in parallel.
+struct OBJChunk {
+    QVector<QVector3D> vertexCoords;
+    QVector<QVector2D> textureCoords;
+    QVector<QVector3D> vertexNormals;
+    QVector<unsigned short> faceValences;
+    QVector<unsigned int> faceCoordInd;
+    QVector<unsigned int> faceTexInd;
+    QVector<unsigned int> faceNormalInd;
+    unsigned int ignoredLines;
+};
+
+// Appends the arrays of all chunks, in order, to target.
+template <typename T>
+static void mergeChunks(QVector<T>& target, QVector<OBJChunk>& chunks, QVector<T> OBJChunk::*array) {
+    QVector<unsigned int> start(chunks.size() + 1);
+
+    start[0] = 0;
+    for (int c = 0; c < chunks.size(); c++) {
+        start[c + 1] = start[c] + (chunks[c].*array).size();
+    }
+
+    target.resize(start[chunks.size()]);
+    T* out = target.data();
+
+    parallelFor(chunks.size(), [&](unsigned int begin, unsigned int end) {
+        for (unsigned int c = begin; c < end; c++) {
+            const QVector<T>& part = chunks[c].*array;
+            std::copy(part.constBegin(), part.constEnd(), out + start[c]);
+            // Release the chunk early, the merged arrays need the memory.
+            chunks[c].*array = QVector<T>();
+        }
+    }, 1);
+}
+
+// Parses the OBJ text in [p, end) into the arrays of obj (an OBJFile or an
+// OBJChunk), returns the number of ignored lines.
+template <typename Output>
+static unsigned int parseOBJ(const char* p, const char* end, Output& obj) {
+    unsigned int ignoredLines = 0;
+    unsigned int index;
+    unsigned short k;
+    float x, y, z;
+
+    while (p < end) {
+        p = skipSpaces(p, end);
+
+        if (p + 1 < end && p[0] == 'v' && isSpace(p[1])) {
+            // Only x, y and z. If there's a w value (homogenous coordinates), ignore it.
+            p = parseFloat(skipSpaces(p + 2, end), end, x);
+            p = parseFloat(skipSpaces(p, end), end, y);
+            p = parseFloat(skipSpaces(p, end), end, z);
+            obj.vertexCoords.append(QVector3D(x, y, z));
+        }
+        else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+            // Only u and v. If there's a w value (barycentric coordinates), ignore it, it can be retrieved from 1-u-v.
+            p = parseFloat(skipSpaces(p + 3, end), end, x);
+            p = parseFloat(skipSpaces(p, end), end, y);
+            obj.textureCoords.append(QVector2D(x, y));
+        }
+        else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+            p = parseFloat(skipSpaces(p + 3, end), end, x);
+            p = parseFloat(skipSpaces(p, end), end, y);
+            p = parseFloat(skipSpaces(p, end), end, z);
+            obj.vertexNormals.append(QVector3D(x, y, z));
+        }
+        else if (p + 1 < end && p[0] == 'f' && isSpace(p[1])) {
+            p = skipSpaces(p + 2, end);
+
+            // Corners are v, v/vt, v//vn or v/vt/vn. Note -1, OBJ starts indexing from 1.
+            for (k = 0; p < end && isDigit(*p); k++) {
+                p = parseIndex(p, end, index);
+                obj.faceCoordInd.append(index - 1);
+
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && isDigit(*p)) {
+                        p = parseIndex(p, end, index);
+                        obj.faceTexInd.append(index - 1);
+                    }
+
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (p < end && isDigit(*p)) {
+                            p = parseIndex(p, end, index);
+                            obj.faceNormalInd.append(index - 1);
+                        }
+                    }
+                }
+
+                p = skipSpaces(p, end);
+            }
+
+            obj.faceValences.append(k);
+        }
+        else if (p < end && *p != '\n') {
+            // Comments, groups, materials, ...
+            ignoredLines++;
+        }
+
+        p = skipLine(p, end);
+        if (p < end) {
+            p++;
+        }
+    }
+
+    return ignoredLines;
+}
+
+// Empty, to be filled by hand.
+OBJFile::OBJFile() {
+    qDebug() << "✓✓ OBJFile constructor (Empty)";
+}
+
 OBJFile::OBJFile(QString fileName) {
     qDebug() << "✓✓ OBJFile constructor";
 
@@ -10,13 +232,17 @@ OBJFile::OBJFile(QString fileName) {
     QFile newModel(fileName);
 
     if(newModel.open(QIODevice::ReadOnly)) {
-        QTextStream fileContents(&newModel);
-
-        QString currentLine;
-        QStringList values;
-        QStringList indices;
+        QByteArray fileContents;
+        uchar* mapped = newModel.map(0, newModel.size());
+        const char* begin = reinterpret_cast<const char*>(mapped);
+        qint64 size = newModel.size();
 
-        unsigned short k;
+        if (!mapped) {
+            // Empty files and devices that cannot be mapped.
+            fileContents = newModel.readAll();
+            begin = fileContents.constData();
+            size = fileContents.size();
+        }
 
         vertexCoords.clear();
         textureCoords.clear();
@@ -25,58 +251,55 @@ OBJFile::OBJFile(QString fileName) {
         faceTexInd.clear();
         faceNormalInd.clear();
 
-        while(!fileContents.atEnd()) {
+        // Large files are split at line ends and the parts are parsed in parallel.
+        // Faces refer to vertices by absolute index, so appending the parts in
+        // order gives exactly the same arrays as parsing the file at once.
+        qint64 numChunks = qBound(qint64(1), size / (1 << 20), qint64(parallelThreadCount()));
+        unsigned int ignoredLines = 0;
 
-            currentLine = fileContents.readLine();
-            values = currentLine.split(" ");
+        if (numChunks == 1) {
+            ignoredLines = parseOBJ(begin, begin + size, *this);
+        } else {
+            QVector<const char*> chunkStart(numChunks + 1);
+            QVector<OBJChunk> chunks(numChunks);
+            const char* end = begin + size;
 
-            if (values[0] == "v") {
-                // qDebug() << "Vertex coords";
-                // Only x, y and z. If there's a w value (homogenous coordinates), ignore it.
-                vertexCoords.append(QVector3D(values[1].toFloat(), values[2].toFloat(), values[3].toFloat() ));
-            }
-            else if (values[0] == "vt") {
-                // qDebug() << "Texture coords";
-                // Only u and v. If there's a w value (barycentric coordinates), ignore it, it can be retrieved from 1-u-v.
-                textureCoords.append(QVector2D(values[1].toFloat(), values[2].toFloat() ));
-            }
-            else if (values[0] == "vn") {
-                // qDebug() << "Vertex normal";
-                vertexNormals.append(QVector3D(values[1].toFloat(), values[2].toFloat(), values[3].toFloat() ));
+            chunkStart[0] = begin;
+            chunkStart[numChunks] = end;
+            for (qint64 c = 1; c < numChunks; c++) {
+                const char* p = qMax(begin + size * c / numChunks, chunkStart[c - 1]);
+                while (p < end && *p != '\n') {
+                    p++;
+                }
+                chunkStart[c] = p < end ? p + 1 : end;
             }
-            else if (values[0] == "f") {
-                // qDebug() << "Face";
-
-                for (k=1; k<values.size(); k++) {
-                    indices = values[k].split("/");
-
-                    // Note -1, OBJ starts indexing from 1.
-
-                    faceCoordInd.append(indices[0].toInt() - 1 );
-
-                    if (indices.size() > 1) {
-                        if (!indices[1].isEmpty()) {
-                            faceTexInd.append(indices[1].toInt() - 1 );
-                        }
-
-                        if (indices.size() > 2) {
-                            if (!indices[2].isEmpty()) {
-                                faceNormalInd.append(indices[2].toInt() - 1 );
-                            }
-                        }
-                    }
 
+            parallelFor(numChunks, [&](unsigned int first, unsigned int last) {
+                for (unsigned int c = first; c < last; c++) {
+                    chunks[c].ignoredLines = parseOBJ(chunkStart[c], chunkStart[c + 1], chunks[c]);
                 }
+            }, 1);
 
-                faceValences.append(k-1);
-
-            }
-            else {
-                qDebug() << " * Line contents ignored," << currentLine;
+            for (qint64 c = 0; c < numChunks; c++) {
+                ignoredLines += chunks[c].ignoredLines;
             }
 
+            mergeChunks(vertexCoords, chunks, &OBJChunk::vertexCoords);
+            mergeChunks(textureCoords, chunks, &OBJChunk::textureCoords);
+            mergeChunks(vertexNormals, chunks, &OBJChunk::vertexNormals);
+            mergeChunks(faceValences, chunks, &OBJChunk::faceValences);
+            mergeChunks(faceCoordInd, chunks, &OBJChunk::faceCoordInd);
+            mergeChunks(faceTexInd, chunks, &OBJChunk::faceTexInd);
+            mergeChunks(faceNormalInd, chunks, &OBJChunk::faceNormalInd);
         }
 
+        if (ignoredLines > 0) {
+            qDebug() << " * Contents of" << ignoredLines << "lines ignored";
+        }
+
+        if (mapped) {
+            newModel.unmap(mapped);
+        }
         newModel.close();
 
     }
@@ -9,6 +9,7 @@
 class OBJFile {
 
 public:
+    OBJFile();
     OBJFile(QString fileName);
     ~OBJFile();
 
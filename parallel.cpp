@@ -0,0 +1,70 @@
+#include "parallel.h"
+
+#include <QThread>
+
+static int threadCount = 0;
+
+int parallelThreadCount() {
+    return threadCount > 0 ? threadCount : QThread::idealThreadCount();
+}
+
+void setParallelThreadCount(int threads) {
+    threadCount = threads > 0 ? threads : 0;
+}
+
+unsigned int parallelChunks(unsigned int n, unsigned int minChunk) {
+    unsigned int numChunks = n / qMax(minChunk, 1u);
+    return qBound(1u, numChunks, (unsigned int) parallelThreadCount());
+}
+
+void parallelRadixSort(QVector<quint64>& keys, QVector<unsigned int>& values, unsigned int keyBits) {
+    const unsigned int digitBits = 8;
+    const unsigned int numDigits = 1u << digitBits;
+    unsigned int n = keys.size();
+    unsigned int numChunks = parallelChunks(n);
+
+    QVector<quint64> keysOut(n);
+    QVector<unsigned int> valuesOut(n);
+    // Offsets per chunk and digit, counts first.
+    QVector<unsigned int> offset(numChunks * numDigits);
+
+    for (unsigned int shift = 0; shift < keyBits; shift += digitBits) {
+        const quint64* in = keys.constData();
+        const unsigned int* inValues = values.constData();
+        quint64* out = keysOut.data();
+        unsigned int* outValues = valuesOut.data();
+        unsigned int* offsets = offset.data();
+
+        offset.fill(0);
+
+        parallelForChunks(n, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+            unsigned int* count = offsets + chunk * numDigits;
+            for (unsigned int k = begin; k < end; k++) {
+                count[(in[k] >> shift) & (numDigits - 1)]++;
+            }
+        });
+
+        // Digit-major, then chunk order keeps the sort stable.
+        unsigned int sum = 0, count;
+        for (unsigned int d = 0; d < numDigits; d++) {
+            for (unsigned int c = 0; c < numChunks; c++) {
+                count = offsets[c * numDigits + d];
+                offsets[c * numDigits + d] = sum;
+                sum += count;
+            }
+        }
+
+        parallelForChunks(n, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+            unsigned int* next = offsets + chunk * numDigits;
+            unsigned int slot;
+            for (unsigned int k = begin; k < end; k++) {
+                slot = next[(in[k] >> shift) & (numDigits - 1)]++;
+                out[slot] = in[k];
+                outValues[slot] = inValues[k];
+            }
+        });
+
+        keys.swap(keysOut);
+        values.swap(valuesOut);
+    }
+}
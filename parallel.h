@@ -0,0 +1,62 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QVector>
+#include <QFuture>
+#include <QtConcurrent>
+
+// Data-parallel loops on the global QThreadPool. A range [0, n) is split into
+// contiguous chunks whose boundaries only depend on n and the chunk count, so
+// per-chunk results (counts, prefix sums) are reproducible. With a thread
+// count of 1 everything runs serially on the calling thread.
+
+// Number of threads used by the loops below, QThread::idealThreadCount() by default.
+int parallelThreadCount();
+// 0 restores the default.
+void setParallelThreadCount(int threads);
+
+// Number of chunks for n items when every chunk should hold at least minChunk of them.
+unsigned int parallelChunks(unsigned int n, unsigned int minChunk = 4096);
+
+inline unsigned int chunkBegin(unsigned int n, unsigned int numChunks, unsigned int chunk) {
+    return (unsigned long long)n * chunk / numChunks;
+}
+
+// Calls body(chunk, begin, end) for every chunk; the calling thread takes chunk 0.
+template <typename Body>
+void parallelForChunks(unsigned int n, unsigned int numChunks, Body body) {
+    if (numChunks <= 1) {
+        body(0u, 0u, n);
+        return;
+    }
+
+    QVector<QFuture<void>> futures;
+    futures.reserve(numChunks - 1);
+
+    for (unsigned int c = 1; c < numChunks; c++) {
+        unsigned int begin = chunkBegin(n, numChunks, c);
+        unsigned int end = chunkBegin(n, numChunks, c + 1);
+        futures.append(QtConcurrent::run([&body, c, begin, end]() { body(c, begin, end); }));
+    }
+
+    body(0u, 0u, chunkBegin(n, numChunks, 1));
+
+    for (int k = 0; k < futures.size(); k++) {
+        futures[k].waitForFinished();
+    }
+}
+
+// Calls body(begin, end) on disjoint ranges covering [0, n).
+template <typename Body>
+void parallelFor(unsigned int n, Body body, unsigned int minChunk = 4096) {
+    parallelForChunks(n, parallelChunks(n, minChunk), [&body](unsigned int, unsigned int begin, unsigned int end) {
+        body(begin, end);
+    });
+}
+
+// Stable LSD radix sort of keys, carrying values along. Only the lowest keyBits
+// bits of the keys are compared. Chunks are counted and scattered in parallel,
+// so equal keys keep their input order for every thread count.
+void parallelRadixSort(QVector<quint64>& keys, QVector<unsigned int>& values, unsigned int keyBits);
+
+#endif // PARALLEL_H
@@ -12,8 +12,12 @@ Settings::Settings()
 
     reflectionLinesDensity = 30;
     drawReflectionLines = false;
+    limitSurface = false;
+    normalWeighting = NormalWeighting::Angle;
+    compactVertices = false;
     modelLoaded = false;
     wireframeMode = true;
+    showCage = false;
     uniformUpdateRequired = true;
 
     rotAngle = 0.0;
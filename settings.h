@@ -3,6 +3,8 @@
 
 #include <QMatrix4x4>
 
+#include "mesh.h"
+
 class Settings
 {
 public:
@@ -10,8 +12,14 @@ public:
 
     bool modelLoaded;
     bool wireframeMode;
+    // Edges of the base mesh over the shown level.
+    bool showCage;
     int reflectionLinesDensity;
     bool drawReflectionLines;
+    bool limitSurface;
+    NormalWeighting normalWeighting;
+    // 16-bit positions, packed normals and 16-bit indices where they fit.
+    bool compactVertices;
 
     int reflectionLineX;
     int reflectionLineY;
@@ -10,11 +10,18 @@ uniform float sineScale;
 uniform vec3 testNormal;
 uniform bool selectionMode;
 uniform bool selectLine;
+uniform bool drawCage;
 
 out vec4 fColor;
 
 void main() {
 
+   // The control cage is yellow
+   if(drawCage) {
+       fColor = vec4(1, 0.85, 0, 1);
+       return;
+   }
+
    // lineSelection gives orange fragments back
    if(selectLine) {
        fColor = vec4(1, 0.27, 0, 1);
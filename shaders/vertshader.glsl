@@ -8,17 +8,21 @@ uniform mat4 modelviewmatrix;
 uniform mat4 projectionmatrix;
 uniform mat3 normalmatrix;
 
+// The compact vertex format gives positions normalized to the bounding box of
+// the level; floats come with offset 0 and scale 1. Its packed normals are
+// decoded by the attribute format itself.
+uniform vec3 positionoffset;
+uniform vec3 positionscale;
+
 layout (location = 0) out vec3 vertcoords_camera_fs;
 layout (location = 1) out vec3 vertnormal_camera_fs;
 layout (location = 2) out vec3 vertnormal_world_fs;
-layout (location = 3) out vec3 vertcoords_ndc;
 
 void main() {
-  gl_Position = projectionmatrix * modelviewmatrix * vec4(vertcoords_world_vs, 1.0);
-  vertcoords_camera_fs = vec3(modelviewmatrix * vec4(vertcoords_world_vs, 1.0));
+  vec3 position = positionoffset + positionscale * vertcoords_world_vs;
 
-  // Computes NDC coordinates for this vertex. Only used for transform feedback buffer.
-  vertcoords_ndc = gl_Position.xyz / gl_Position.w;
+  gl_Position = projectionmatrix * modelviewmatrix * vec4(position, 1.0);
+  vertcoords_camera_fs = vec3(modelviewmatrix * vec4(position, 1.0));
 
   vertnormal_camera_fs = normalize(normalmatrix * vertnormal_world_vs);
   vertnormal_world_fs = vertnormal_world_vs;
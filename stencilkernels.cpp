@@ -0,0 +1,235 @@
+#include "stencilkernels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define STENCILS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each kernel for its own instruction set; MSVC accepts
+// the intrinsics anywhere.
+#if defined(__GNUC__)
+#define STENCILS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define STENCILS_TARGET(isa)
+#endif
+
+// AVX-512 implies FMA, and GCC would fuse the multiplies and adds of that
+// kernel again. Clang and MSVC do not fuse separate intrinsics.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+static int levelLimit = -1;
+
+static SimdLevel detectSimd() {
+#if defined(STENCILS_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::SSE41;
+    }
+#elif defined(STENCILS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] >> 19) & 1;
+    // The OS saves the YMM (and ZMM) registers.
+    bool osAVX = ((info[2] >> 27) & 1) && (_xgetbv(0) & 0x6) == 0x6;
+    bool osAVX512 = osAVX && (_xgetbv(0) & 0xE6) == 0xE6;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        if (osAVX512 && ((info[1] >> 16) & 1)) {
+            return SimdLevel::AVX512;
+        }
+        if (osAVX && ((info[1] >> 5) & 1)) {
+            return SimdLevel::AVX2;
+        }
+    }
+    if (sse41) {
+        return SimdLevel::SSE41;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+SimdLevel simdSupported() {
+    static const SimdLevel supported = detectSimd();
+    return supported;
+}
+
+SimdLevel simdLevel() {
+    SimdLevel supported = simdSupported();
+    return levelLimit < 0 ? supported : std::min(SimdLevel(levelLimit), supported);
+}
+
+void setSimdLevel(SimdLevel level) {
+    levelLimit = int(level);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE41:
+        return "sse4.1";
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+// Stencils [begin, count). Also does the ones left over by the vector kernels.
+static void stencilsScalar(const float* x, const float* y, const float* z,
+                           const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                           unsigned int begin, unsigned int count, float* outX, float* outY, float* outZ) {
+    for (unsigned int i = begin; i < count; i++) {
+        float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+        for (unsigned int t = 0; t < numTaps; t++) {
+            unsigned int v = taps[t * stride + i];
+            sumX += weights[t] * x[v];
+            sumY += weights[t] * y[v];
+            sumZ += weights[t] * z[v];
+        }
+        outX[i] = sumX;
+        outY[i] = sumY;
+        outZ[i] = sumZ;
+    }
+}
+
+#ifdef STENCILS_X86
+
+// The vector kernels return how many stencils they did, a multiple of their
+// width. With Taps > 0 the tap count is known at compile time and the loop over
+// the taps is unrolled.
+
+template <unsigned int Taps>
+STENCILS_TARGET("sse4.1")
+static unsigned int stencilsSSE41(const float* x, const float* y, const float* z,
+                                  const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                                  unsigned int count, float* outX, float* outY, float* outZ) {
+    unsigned int i;
+
+    // No gathers before AVX2, the four lanes are loaded one by one.
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128 sumX = _mm_setzero_ps(), sumY = _mm_setzero_ps(), sumZ = _mm_setzero_ps();
+        for (unsigned int t = 0; t < (Taps ? Taps : numTaps); t++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(taps + t * stride + i));
+            unsigned int v0 = _mm_extract_epi32(v, 0), v1 = _mm_extract_epi32(v, 1);
+            unsigned int v2 = _mm_extract_epi32(v, 2), v3 = _mm_extract_epi32(v, 3);
+            __m128 w = _mm_set1_ps(weights[t]);
+            sumX = _mm_add_ps(sumX, _mm_mul_ps(w, _mm_setr_ps(x[v0], x[v1], x[v2], x[v3])));
+            sumY = _mm_add_ps(sumY, _mm_mul_ps(w, _mm_setr_ps(y[v0], y[v1], y[v2], y[v3])));
+            sumZ = _mm_add_ps(sumZ, _mm_mul_ps(w, _mm_setr_ps(z[v0], z[v1], z[v2], z[v3])));
+        }
+        _mm_storeu_ps(outX + i, sumX);
+        _mm_storeu_ps(outY + i, sumY);
+        _mm_storeu_ps(outZ + i, sumZ);
+    }
+    return i;
+}
+
+template <unsigned int Taps>
+STENCILS_TARGET("avx2")
+static unsigned int stencilsAVX2(const float* x, const float* y, const float* z,
+                                 const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                                 unsigned int count, float* outX, float* outY, float* outZ) {
+    unsigned int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256 sumX = _mm256_setzero_ps(), sumY = _mm256_setzero_ps(), sumZ = _mm256_setzero_ps();
+        for (unsigned int t = 0; t < (Taps ? Taps : numTaps); t++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(taps + t * stride + i));
+            __m256 w = _mm256_set1_ps(weights[t]);
+            sumX = _mm256_add_ps(sumX, _mm256_mul_ps(w, _mm256_i32gather_ps(x, v, 4)));
+            sumY = _mm256_add_ps(sumY, _mm256_mul_ps(w, _mm256_i32gather_ps(y, v, 4)));
+            sumZ = _mm256_add_ps(sumZ, _mm256_mul_ps(w, _mm256_i32gather_ps(z, v, 4)));
+        }
+        _mm256_storeu_ps(outX + i, sumX);
+        _mm256_storeu_ps(outY + i, sumY);
+        _mm256_storeu_ps(outZ + i, sumZ);
+    }
+    return i;
+}
+
+template <unsigned int Taps>
+STENCILS_TARGET("avx512f")
+static unsigned int stencilsAVX512(const float* x, const float* y, const float* z,
+                                   const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                                   unsigned int count, float* outX, float* outY, float* outZ) {
+    unsigned int i;
+
+    // The masked gathers have a defined source, unlike _mm512_i32gather_ps in GCC.
+    const __m512 zero = _mm512_setzero_ps();
+    const __mmask16 all = 0xFFFF;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m512 sumX = _mm512_setzero_ps(), sumY = _mm512_setzero_ps(), sumZ = _mm512_setzero_ps();
+        for (unsigned int t = 0; t < (Taps ? Taps : numTaps); t++) {
+            __m512i v = _mm512_loadu_si512((const void*)(taps + t * stride + i));
+            __m512 w = _mm512_set1_ps(weights[t]);
+            sumX = _mm512_add_ps(sumX, _mm512_mul_ps(w, _mm512_mask_i32gather_ps(zero, all, v, x, 4)));
+            sumY = _mm512_add_ps(sumY, _mm512_mul_ps(w, _mm512_mask_i32gather_ps(zero, all, v, y, 4)));
+            sumZ = _mm512_add_ps(sumZ, _mm512_mul_ps(w, _mm512_mask_i32gather_ps(zero, all, v, z, 4)));
+        }
+        _mm512_storeu_ps(outX + i, sumX);
+        _mm512_storeu_ps(outY + i, sumY);
+        _mm512_storeu_ps(outZ + i, sumZ);
+    }
+    return i;
+}
+
+template <unsigned int Taps>
+static unsigned int stencilsVector(const float* x, const float* y, const float* z,
+                                   const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                                   unsigned int count, float* outX, float* outY, float* outZ) {
+    switch (simdLevel()) {
+    case SimdLevel::AVX512:
+        return stencilsAVX512<Taps>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+    case SimdLevel::AVX2:
+        return stencilsAVX2<Taps>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+    case SimdLevel::SSE41:
+        return stencilsSSE41<Taps>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+    default:
+        return 0;
+    }
+}
+
+#endif // STENCILS_X86
+
+void evaluateStencils(const float* x, const float* y, const float* z,
+                      const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                      unsigned int count, float* outX, float* outY, float* outZ) {
+    unsigned int done = 0;
+
+#ifdef STENCILS_X86
+    // Boundary vertices, edges and regular vertices.
+    switch (numTaps) {
+    case 3:
+        done = stencilsVector<3>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+        break;
+    case 4:
+        done = stencilsVector<4>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+        break;
+    case 7:
+        done = stencilsVector<7>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+        break;
+    default:
+        done = stencilsVector<0>(x, y, z, taps, stride, weights, numTaps, count, outX, outY, outZ);
+        break;
+    }
+#endif
+
+    stencilsScalar(x, y, z, taps, stride, weights, numTaps, done, count, outX, outY, outZ);
+}
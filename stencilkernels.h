@@ -0,0 +1,42 @@
+#ifndef STENCILKERNELS_H
+#define STENCILKERNELS_H
+
+#include <cfloat>
+
+// Batches of fixed-weight stencils over structure-of-arrays coordinates, like
+// the vertexX/Y/Z arrays of a Mesh. The kernel is picked once at runtime from
+// what the CPU supports: AVX-512 (16 stencils at a time), AVX2 (8, with
+// gathers), SSE4.1 (4) or plain C++.
+//
+// A batch holds count stencils with numTaps taps each, stored per tap: tap t
+// of stencil i is vertex taps[t * stride + i], and every stencil of the batch
+// has weight weights[t] on it. Stencil i gives the sum over t of weights[t]
+// times the coordinates of its tap t, accumulated in tap order.
+//
+// All kernels do the same float operations in the same order, with a separate
+// multiply and add (no fused multiply-add), so a stencil gives the same bits
+// whichever kernel or the scalar tail of a batch computes it, and results do
+// not depend on the batch split or the thread count. They differ from vertexPoint
+// and edgePoint, which order their sums differently, by at most
+// StencilTolerance times the largest absolute coordinate among the taps.
+
+enum class SimdLevel { Scalar, SSE41, AVX2, AVX512 };
+
+static const float StencilTolerance = 8.0f * FLT_EPSILON;
+
+// Stencils per batch that the callers in meshtools.cpp collect.
+static const unsigned int StencilBatchSize = 256;
+
+// The best level the CPU and operating system support.
+SimdLevel simdSupported();
+// The level in use, simdSupported() unless lowered by setSimdLevel.
+SimdLevel simdLevel();
+// Levels above simdSupported() are lowered to it, e.g. to compare the kernels.
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+void evaluateStencils(const float* x, const float* y, const float* z,
+                      const unsigned int* taps, unsigned int stride, const float* weights, unsigned int numTaps,
+                      unsigned int count, float* outX, float* outY, float* outZ);
+
+#endif // STENCILKERNELS_H
@@ -0,0 +1,257 @@
+#include "stenciltable.h"
+#include "parallel.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <memory>
+
+// Weights of the vertices of one level in a vertex of the next one.
+struct StencilWeight {
+    unsigned int vertex;
+    float weight;
+};
+
+typedef QVarLengthArray<StencilWeight, 32> StencilMask;
+
+static inline void addWeight(StencilMask& mask, unsigned int vertex, float weight) {
+    StencilWeight w = { vertex, weight };
+    mask.append(w);
+}
+
+// The rules of vertexPoint.
+static void vertexMask(const Mesh& mesh, unsigned int v, StencilMask& mask) {
+    unsigned int firstEdge = mesh.out(v);
+    unsigned int currentEdge = firstEdge;
+    unsigned int previousVertex = Mesh::NoIndex;
+    unsigned int nextVertex = Mesh::NoIndex;
+    unsigned short n = mesh.valence(v);
+
+    mask.clear();
+
+    if (firstEdge == Mesh::NoIndex) {
+        addWeight(mask, v, 1.0f);
+        return;
+    }
+
+    for (unsigned short k = 0; k < n; k++) {
+        if (mesh.face(currentEdge) == Mesh::NoIndex) {
+            nextVertex = mesh.target(currentEdge);
+        }
+        if (mesh.face(mesh.twin(currentEdge)) == Mesh::NoIndex) {
+            previousVertex = mesh.target(currentEdge);
+        }
+        currentEdge = mesh.next(mesh.twin(currentEdge));
+    }
+
+    if (previousVertex != Mesh::NoIndex && nextVertex != Mesh::NoIndex) {
+        addWeight(mask, previousVertex, 1.0f/8.0f);
+        addWeight(mask, v, 6.0f/8.0f);
+        addWeight(mask, nextVertex, 1.0f/8.0f);
+        return;
+    }
+
+    float stencilValue = (n == 3) ? 3.0/16.0 : 3.0/(8*n);
+
+    addWeight(mask, v, 1.0 - n*stencilValue);
+    currentEdge = firstEdge;
+    for (unsigned short k = 0; k < n; k++) {
+        addWeight(mask, mesh.target(currentEdge), stencilValue);
+        currentEdge = mesh.next(mesh.twin(currentEdge));
+    }
+}
+
+// The rules of edgePoint.
+static void edgeMask(const Mesh& mesh, unsigned int h, StencilMask& mask) {
+    unsigned int twinEdge = mesh.twin(h);
+
+    mask.clear();
+
+    if (mesh.face(twinEdge) == Mesh::NoIndex || mesh.face(h) == Mesh::NoIndex) {
+        addWeight(mask, mesh.target(h), 0.5f);
+        addWeight(mask, mesh.target(twinEdge), 0.5f);
+    } else {
+        addWeight(mask, mesh.target(h), 6.0f/16.0f);
+        addWeight(mask, mesh.target(mesh.next(h)), 2.0f/16.0f);
+        addWeight(mask, mesh.target(twinEdge), 6.0f/16.0f);
+        addWeight(mask, mesh.target(mesh.next(twinEdge)), 2.0f/16.0f);
+    }
+}
+
+StencilTable::StencilTable() {
+    qDebug() << "✓✓ StencilTable constructor (Empty)";
+
+    numControls = 0;
+    numLevels = 0;
+    start.fill(0, 1);
+}
+
+StencilTable::StencilTable(const Mesh& base, unsigned int levels) {
+    qDebug() << "✓✓ StencilTable constructor";
+
+    numControls = base.numVertices();
+    numLevels = levels;
+
+    // Level 0 is the identity.
+    start.resize(numControls + 1);
+    indices.resize(numControls);
+    weights.fill(1.0f, numControls);
+    for (unsigned int k = 0; k < numControls; k++) {
+        start[k] = k;
+        indices[k] = k;
+    }
+    start[numControls] = numControls;
+
+    // Every level needs the connectivity of the previous one; the positions
+    // computed along with it are not used.
+    const Mesh* mesh = &base;
+    std::unique_ptr<Mesh> current;
+
+    for (unsigned int l = 0; l < levels; l++) {
+        refine(*mesh);
+        qDebug() << " * Stencils of level" << l + 1 << ":" << numStencils() << "rows," << numWeights() << "weights";
+
+        if (l + 1 < levels) {
+            std::unique_ptr<Mesh> refined(new Mesh());
+            mesh->subdivideLoop(*refined);
+            current = std::move(refined);
+            mesh = current.get();
+        }
+    }
+}
+
+StencilTable::~StencilTable() {
+    qDebug() << "✗✗ StencilTable destructor";
+}
+
+// Replaces the stencils of the vertices of mesh by those of the vertices of
+// the next level: the vertex points, then the edge points in HalfEdge order.
+void StencilTable::refine(const Mesh& mesh) {
+    unsigned int numVerts = mesh.numVertices();
+    unsigned int numHalfEdges = mesh.numHalfEdges();
+    unsigned int numChunks = parallelChunks(numHalfEdges);
+    QVector<unsigned int> chunkStart(numChunks + 1);
+
+    // The HalfEdge of every edge point, counted per chunk like in subdivideLoop.
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int count = 0;
+        for (unsigned int k = begin; k < end; k++) {
+            count += k < mesh.twin(k);
+        }
+        chunkStart[chunk + 1] = count;
+    });
+
+    chunkStart[0] = 0;
+    for (unsigned int c = 0; c < numChunks; c++) {
+        chunkStart[c + 1] += chunkStart[c];
+    }
+
+    QVector<unsigned int> edgeHalfEdge(chunkStart[numChunks]);
+    unsigned int* edgeHalfEdges = edgeHalfEdge.data();
+
+    parallelForChunks(numHalfEdges, numChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        unsigned int e = chunkStart[chunk];
+        for (unsigned int k = begin; k < end; k++) {
+            if (k < mesh.twin(k)) {
+                edgeHalfEdges[e++] = k;
+            }
+        }
+    });
+
+    // Every row is the sum of the old rows of its mask. The rows of a chunk are
+    // collected on their own and concatenated in order afterwards.
+    unsigned int numRows = numVerts + edgeHalfEdge.size();
+    unsigned int numRowChunks = parallelChunks(numRows, 1024);
+    QVector<QVector<unsigned int> > chunkIndices(numRowChunks);
+    QVector<QVector<float> > chunkWeights(numRowChunks);
+    QVector<unsigned int> newStart(numRows + 1);
+    unsigned int* rowSize = newStart.data() + 1;
+
+    parallelForChunks(numRows, numRowChunks, [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+        // Sparse accumulator over the control points.
+        QVector<float> sum(numControls, 0.0f);
+        QVector<unsigned int> stamp(numControls, Mesh::NoIndex);
+        QVector<unsigned int> touched;
+        QVector<unsigned int>& outIndices = chunkIndices[chunk];
+        QVector<float>& outWeights = chunkWeights[chunk];
+        StencilMask mask;
+
+        for (unsigned int r = begin; r < end; r++) {
+            if (r < numVerts) {
+                vertexMask(mesh, r, mask);
+            } else {
+                edgeMask(mesh, edgeHalfEdges[r - numVerts], mask);
+            }
+
+            touched.clear();
+            for (int m = 0; m < mask.size(); m++) {
+                unsigned int v = mask[m].vertex;
+                for (unsigned int j = start[v]; j < start[v + 1]; j++) {
+                    unsigned int c = indices[j];
+                    if (stamp[c] != r) {
+                        stamp[c] = r;
+                        touched.append(c);
+                    }
+                    sum[c] += mask[m].weight * weights[j];
+                }
+            }
+
+            std::sort(touched.begin(), touched.end());
+            for (int t = 0; t < touched.size(); t++) {
+                outIndices.append(touched[t]);
+                outWeights.append(sum[touched[t]]);
+                sum[touched[t]] = 0.0f;
+            }
+            rowSize[r] = touched.size();
+        }
+    });
+
+    newStart[0] = 0;
+    for (unsigned int r = 0; r < numRows; r++) {
+        newStart[r + 1] += newStart[r];
+    }
+
+    start.swap(newStart);
+    indices.resize(start[numRows]);
+    weights.resize(start[numRows]);
+
+    unsigned int* outIndices = indices.data();
+    float* outWeights = weights.data();
+
+    parallelFor(numRowChunks, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int c = begin; c < end; c++) {
+            unsigned int first = start[chunkBegin(numRows, numRowChunks, c)];
+            std::copy(chunkIndices[c].constBegin(), chunkIndices[c].constEnd(), outIndices + first);
+            std::copy(chunkWeights[c].constBegin(), chunkWeights[c].constEnd(), outWeights + first);
+        }
+    }, 1);
+}
+
+QVector3D StencilTable::evaluate(unsigned int k, const QVector<QVector3D>& control) const {
+    const unsigned int* index = indices.constData();
+    const float* weight = weights.constData();
+    const QVector3D* points = control.constData();
+    QVector3D point;
+
+    for (unsigned int j = start[k]; j < start[k + 1]; j++) {
+        point += weight[j] * points[index[j]];
+    }
+
+    return point;
+}
+
+void StencilTable::evaluate(const QVector<QVector3D>& control, QVector<QVector3D>& positions) const {
+    unsigned int n = numStencils();
+
+    if (positions.size() != int(n)) {
+        positions.resize(n);
+    }
+
+    QVector3D* out = positions.data();
+
+    parallelFor(n, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int k = begin; k < end; k++) {
+            out[k] = evaluate(k, control);
+        }
+    }, 1024);
+}
@@ -0,0 +1,47 @@
+#ifndef STENCILTABLE_H
+#define STENCILTABLE_H
+
+#include "mesh.h"
+
+// Loop subdivision as a sparse matrix. Row k holds the weights of the base
+// vertices (control points) in vertex k of a fixed level, with the vertices
+// numbered like subdivideLoop numbers them. The table only depends on the
+// connectivity of the base mesh, so moving the control points just takes a
+// sparse matrix-vector product instead of subdividing again.
+//
+// Rows are stored back to back: row k covers [rowStart(k), rowStart(k+1)) of
+// the index and weight arrays, with ascending indices.
+class StencilTable {
+
+public:
+    StencilTable();
+    // Stencils of the vertices of level levels of base (0 gives the identity).
+    StencilTable(const Mesh& base, unsigned int levels);
+    ~StencilTable();
+
+    inline unsigned int numControlPoints() const { return numControls; }
+    inline unsigned int numStencils() const { return start.size() - 1; }
+    inline unsigned int numWeights() const { return indices.size(); }
+    inline unsigned int level() const { return numLevels; }
+
+    inline unsigned int rowStart(unsigned int k) const { return start[k]; }
+    inline const unsigned int* rowIndices(unsigned int k) const { return indices.constData() + start[k]; }
+    inline const float* rowWeights(unsigned int k) const { return weights.constData() + start[k]; }
+
+    // Evaluates a single stencil.
+    QVector3D evaluate(unsigned int k, const QVector<QVector3D>& control) const;
+    // Evaluates all stencils in parallel. positions is only reallocated if it
+    // does not have numStencils() entries yet.
+    void evaluate(const QVector<QVector3D>& control, QVector<QVector3D>& positions) const;
+
+private:
+    void refine(const Mesh& mesh);
+
+    unsigned int numControls;
+    unsigned int numLevels;
+    QVector<unsigned int> start;
+    QVector<unsigned int> indices;
+    QVector<float> weights;
+};
+
+#endif // STENCILTABLE_H
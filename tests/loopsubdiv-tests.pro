@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Regression tests for the mesh core. A console
+# program that exits with the number of failed
+# tests; "make check" runs it.
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+DEFINES  += QT_NO_DEBUG_OUTPUT
+
+TARGET = loopsubdiv-tests
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES += main.cpp
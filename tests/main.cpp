@@ -0,0 +1,211 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+
+#include "objfile.h"
+#include "mesh.h"
+#include "meshtools.h"
+#include "parallel.h"
+#include "stencilkernels.h"
+
+#include <cstring>
+
+// Every test returns whether it passed and explains a failure with fail().
+
+static QTextStream out(stdout);
+
+static bool fail(const QString& message) {
+    out << "    " << message << "\n";
+    return false;
+}
+
+// Tetrahedron, followed by extra vertices that no face uses.
+static OBJFile tetrahedron(unsigned int isolated) {
+    OBJFile obj;
+    const unsigned int faces[12] = { 0, 1, 2,  0, 2, 3,  0, 3, 1,  1, 3, 2 };
+
+    obj.vertexCoords << QVector3D(1, 1, 1) << QVector3D(1, -1, -1) << QVector3D(-1, 1, -1) << QVector3D(-1, -1, 1);
+    for (unsigned int k = 0; k < isolated; k++) {
+        obj.vertexCoords << QVector3D(k, 2.0f * k, 3.0f * k);
+    }
+    for (unsigned int f = 0; f < 4; f++) {
+        obj.faceValences << 3;
+        obj.faceCoordInd << faces[3*f] << faces[3*f + 1] << faces[3*f + 2];
+    }
+    return obj;
+}
+
+// More isolated vertices than HalfEdges: every level keeps them in place and
+// without a HalfEdge, in both layouts.
+static bool testIsolatedVertices() {
+    const unsigned int isolated = 100;
+    OBJFile obj = tetrahedron(isolated);
+
+    for (int implicit = 0; implicit < 2; implicit++) {
+        Mesh mesh(&obj, implicit == 1);
+
+        for (int l = 1; l <= 3; l++) {
+            Mesh child;
+            mesh.subdivideLoop(child);
+            mesh = child;
+
+            for (unsigned int v = 4; v < 4 + isolated; v++) {
+                if (mesh.out(v) != Mesh::NoIndex) {
+                    return fail(QString("level %1: isolated vertex %2 has a HalfEdge").arg(l).arg(v));
+                }
+                if (mesh.coords(v) != obj.vertexCoords[v]) {
+                    return fail(QString("level %1: isolated vertex %2 moved").arg(l).arg(v));
+                }
+            }
+            for (unsigned int v = 0; v < mesh.numVertices(); v++) {
+                if ((v < 4 || v >= 4 + isolated) && mesh.out(v) >= mesh.numHalfEdges()) {
+                    return fail(QString("level %1: vertex %2 has no HalfEdge").arg(l).arg(v));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Overwrites the quint32 at offset in fileName.
+static bool patchFile(const QString& fileName, qint64 offset, quint32 value) {
+    QFile file(fileName);
+    bool ok = file.open(QIODevice::ReadWrite) && file.seek(offset)
+            && file.write(reinterpret_cast<const char*>(&value), sizeof(value)) == sizeof(value);
+    file.close();
+    return ok;
+}
+
+// Binary files of an open tetrahedron load again in both layouts, but not
+// after one target or twin is overwritten; the mesh read into keeps its arrays.
+static bool testCorruptMeshFile() {
+    const QString fileName = QDir::tempPath() + "/loopsubdiv-tests.lsdmesh";
+    OBJFile obj = tetrahedron(0);
+    obj.faceValences.removeLast();
+    obj.faceCoordInd.resize(9);
+
+    for (int implicit = 0; implicit < 2; implicit++) {
+        Mesh base(&obj, implicit == 1);
+        Mesh mesh;
+        base.subdivideLoop(mesh);
+
+        Mesh loaded;
+        if (!mesh.writeBinary(fileName) || !loaded.readBinary(fileName)) {
+            return fail("the mesh does not load again");
+        }
+        for (unsigned int h = 0; h < mesh.numHalfEdges(); h++) {
+            if (loaded.target(h) != mesh.target(h) || loaded.twin(h) != mesh.twin(h) || loaded.next(h) != mesh.next(h)) {
+                return fail(QString("HalfEdge %1 differs after loading").arg(h));
+            }
+        }
+
+        // Header of 40 bytes, then three coordinate arrays, vertexOut and
+        // vertexVal, each padded to 8 bytes.
+        qint64 numVerts = mesh.numVertices();
+        qint64 targets = 40 + 4 * ((4 * numVerts + 7) & ~7) + ((2 * numVerts + 7) & ~7);
+        qint64 twins = targets + ((4 * qint64(mesh.numHalfEdges()) + 7) & ~7);
+        const struct {
+            qint64 offset;
+            quint32 value;
+        } corruptions[2] = {
+            { targets, quint32(numVerts + 5) },
+            { twins, mesh.twin(1) },
+        };
+
+        for (int c = 0; c < 2; c++) {
+            if (!mesh.writeBinary(fileName) || !patchFile(fileName, corruptions[c].offset, corruptions[c].value)) {
+                return fail("could not write the corrupt file");
+            }
+            if (loaded.readBinary(fileName)) {
+                return fail(QString("corruption %1 was accepted").arg(c));
+            }
+            if (loaded.numVertices() != mesh.numVertices() || loaded.numHalfEdges() != mesh.numHalfEdges()
+                    || loaded.target(0) != mesh.target(0) || loaded.twin(0) != mesh.twin(0)) {
+                return fail(QString("corruption %1 changed the mesh").arg(c));
+            }
+        }
+    }
+
+    QFile::remove(fileName);
+    return true;
+}
+
+// Level 6 of a closed and an open tetrahedron, with every stencil kernel, on
+// one thread and on four: all give the same bits as the scalar kernel on one
+// thread, so neither the instruction set nor the split into batches and
+// chunks changes the result.
+static bool testStencilThreads() {
+    const SimdLevel simdLevels[4] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512 };
+    const int threads[2] = { 1, 4 };
+    SimdLevel previousLevel = simdLevel();
+    bool passed = true;
+
+    for (int open = 0; passed && open < 2; open++) {
+        OBJFile obj = tetrahedron(0);
+        if (open == 1) {
+            obj.faceValences.removeLast();
+            obj.faceCoordInd.resize(9);
+        }
+        // Not dyadic like the weights, so that the products of the stencils round.
+        for (int v = 0; v < obj.vertexCoords.size(); v++) {
+            obj.vertexCoords[v] = obj.vertexCoords[v] * QVector3D(0.3f, 0.7f, 1.1f) + QVector3D(0.1f, 0.2f, 0.3f) * v;
+        }
+        QVector<float> reference;
+
+        for (int s = 0; passed && s < 4; s++) {
+            for (int t = 0; passed && t < 2; t++) {
+                setSimdLevel(simdLevels[s]);
+                setParallelThreadCount(threads[t]);
+
+                Mesh mesh(&obj);
+                for (int l = 1; l <= 6; l++) {
+                    Mesh child;
+                    mesh.subdivideLoop(child);
+                    mesh = child;
+                }
+
+                QVector<float> coords;
+                coords.reserve(3 * mesh.numVertices());
+                for (unsigned int v = 0; v < mesh.numVertices(); v++) {
+                    coords << mesh.getVertexX()[v] << mesh.getVertexY()[v] << mesh.getVertexZ()[v];
+                }
+
+                if (reference.isEmpty()) {
+                    reference = coords;
+                } else if (memcmp(coords.constData(), reference.constData(), sizeof(float) * coords.size()) != 0) {
+                    passed = fail(QString("%1 on %2 threads differs from %3 on 1 thread")
+                                  .arg(simdLevelName(simdLevel())).arg(threads[t]).arg(simdLevelName(SimdLevel::Scalar)));
+                }
+            }
+        }
+    }
+
+    setSimdLevel(previousLevel);
+    setParallelThreadCount(0);
+    return passed;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    struct Test {
+        const char* name;
+        bool (*run)();
+    };
+    const Test tests[] = {
+        { "isolated vertices", testIsolatedVertices },
+        { "corrupt mesh file", testCorruptMeshFile },
+        { "stencil threads", testStencilThreads },
+    };
+
+    int failed = 0;
+    for (const Test& test : tests) {
+        bool passed = test.run();
+        out << (passed ? "PASS " : "FAIL ") << test.name << "\n";
+        out.flush();
+        failed += passed ? 0 : 1;
+    }
+
+    return failed;
+}